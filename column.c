@@ -0,0 +1,222 @@
+#include "column.h"
+#include <stdlib.h>
+#include <string.h>
+
+static inline uint64_t load_be64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static inline void store_be64(uint8_t *p, uint64_t v) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  memcpy(p, &v, sizeof(v));
+}
+
+void ulid_get_times_scalar(const ULID *ulids, size_t n, uint64_t *times_ms) {
+  for (size_t j = 0; j < n; ++j) {
+    times_ms[j] = load_be64(ulids[j].data) >> 16;
+  }
+}
+
+void ulid_time_range_scalar(const uint64_t *times_ms, size_t n,
+                            uint64_t *min_ms, uint64_t *max_ms) {
+  uint64_t lo = times_ms[0], hi = times_ms[0];
+  for (size_t j = 1; j < n; ++j) {
+    lo = times_ms[j] < lo ? times_ms[j] : lo;
+    hi = times_ms[j] > hi ? times_ms[j] : hi;
+  }
+  *min_ms = lo;
+  *max_ms = hi;
+}
+
+void ULID_GetTimeMany(const ULID *ulids, const size_t n, uint64_t *times_ms) {
+  ulid_kernels()->get_times(ulids, n, times_ms);
+}
+
+int ULID_TimeRange(const uint64_t *times_ms, const size_t n, uint64_t *min_ms,
+                   uint64_t *max_ms) {
+  if (n == 0) {
+    return 0;
+  }
+  ulid_kernels()->time_range(times_ms, n, min_ms, max_ms);
+  return 1;
+}
+
+void ULID_TimeHistogram(const uint64_t *times_ms, const size_t n,
+                        const uint64_t start_ms, const uint64_t bucket_ms,
+                        uint64_t *counts, const size_t buckets) {
+  if (bucket_ms == 0 || buckets == 0) {
+    return;
+  }
+  // Times past the last bucket are skipped, so offsets stay below span.
+  uint64_t span = bucket_ms * buckets;
+  if (span / buckets != bucket_ms) {
+    span = UINT64_MAX;
+  }
+  // Divide by multiplying with a reciprocal, rounded up: the quotient is then
+  // exact or one too big, and one compare fixes it.
+  const uint64_t reciprocal =
+      bucket_ms == 1 ? 0 : UINT64_MAX / bucket_ms + 1;
+  for (size_t j = 0; j < n; ++j) {
+    uint64_t offset = times_ms[j] - start_ms;
+    if (times_ms[j] < start_ms || offset >= span) {
+      continue;
+    }
+    uint64_t bucket = offset;
+    if (reciprocal) {
+      bucket = (uint64_t)(((unsigned __int128)offset * reciprocal) >> 64);
+      bucket -= bucket * bucket_ms > offset;
+    }
+    ++counts[bucket];
+  }
+}
+
+/*
+ * Column
+ */
+
+int ULID_Column_Init(ULID_Column *column, const size_t capacity) {
+  memset(column, 0, sizeof(*column));
+  if (capacity == 0) {
+    return 1;
+  }
+  column->time_ms = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+  column->entropy_hi = (uint16_t *)malloc(capacity * sizeof(uint16_t));
+  column->entropy_lo = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+  if (!column->time_ms || !column->entropy_hi || !column->entropy_lo) {
+    ULID_Column_Free(column);
+    return 0;
+  }
+  column->capacity = capacity;
+  return 1;
+}
+
+void ULID_Column_Free(ULID_Column *column) {
+  free(column->time_ms);
+  free(column->entropy_hi);
+  free(column->entropy_lo);
+  memset(column, 0, sizeof(*column));
+}
+
+static int reserve(ULID_Column *column, size_t capacity) {
+  if (capacity <= column->capacity) {
+    return 1;
+  }
+  if (capacity < 2 * column->capacity) {
+    capacity = 2 * column->capacity;
+  }
+  uint64_t *time_ms =
+      (uint64_t *)realloc(column->time_ms, capacity * sizeof(uint64_t));
+  if (!time_ms) {
+    return 0;
+  }
+  column->time_ms = time_ms;
+  uint16_t *entropy_hi =
+      (uint16_t *)realloc(column->entropy_hi, capacity * sizeof(uint16_t));
+  if (!entropy_hi) {
+    return 0;
+  }
+  column->entropy_hi = entropy_hi;
+  uint64_t *entropy_lo =
+      (uint64_t *)realloc(column->entropy_lo, capacity * sizeof(uint64_t));
+  if (!entropy_lo) {
+    return 0;
+  }
+  column->entropy_lo = entropy_lo;
+  column->capacity = capacity;
+  return 1;
+}
+
+int ULID_Column_Append(ULID_Column *column, const ULID *ulids,
+                       const size_t n) {
+  if (!reserve(column, column->count + n)) {
+    return 0;
+  }
+  ULID_GetTimeMany(ulids, n, column->time_ms + column->count);
+  uint16_t *entropy_hi = column->entropy_hi + column->count;
+  uint64_t *entropy_lo = column->entropy_lo + column->count;
+  for (size_t j = 0; j < n; ++j) {
+    entropy_hi[j] = (uint16_t)(ulids[j].data[6] << 8 | ulids[j].data[7]);
+    entropy_lo[j] = load_be64(ulids[j].data + 8);
+  }
+  column->count += n;
+  return 1;
+}
+
+void ULID_Column_Get(const ULID_Column *column, const size_t first,
+                     const size_t n, ULID *out) {
+  for (size_t j = 0; j < n; ++j) {
+    size_t row = first + j;
+    store_be64(out[j].data,
+               column->time_ms[row] << 16 | column->entropy_hi[row]);
+    store_be64(out[j].data + 8, column->entropy_lo[row]);
+  }
+}
+
+// Compare row with (time_ms, hi, lo), the same way as ULID_Compare().
+static inline int compare_row(const ULID_Column *column, size_t row,
+                              uint64_t time_ms, uint16_t hi, uint64_t lo) {
+  if (column->time_ms[row] != time_ms) {
+    return column->time_ms[row] < time_ms ? -1 : +1;
+  }
+  if (column->entropy_hi[row] != hi) {
+    return column->entropy_hi[row] < hi ? -1 : +1;
+  }
+  if (column->entropy_lo[row] != lo) {
+    return column->entropy_lo[row] < lo ? -1 : +1;
+  }
+  return 0;
+}
+
+int ULID_Column_Compare(const ULID_Column *column, const size_t l,
+                        const size_t r) {
+  return compare_row(column, l, column->time_ms[r], column->entropy_hi[r],
+                     column->entropy_lo[r]);
+}
+
+int ULID_Column_IsSorted(const ULID_Column *column) {
+  for (size_t row = 1; row < column->count; ++row) {
+    if (ULID_Column_Compare(column, row - 1, row) > 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+size_t ULID_Column_LowerBound(const ULID_Column *column, const ULID *ulid) {
+  const uint64_t time_ms = load_be64(ulid->data) >> 16;
+  const uint16_t hi = (uint16_t)(ulid->data[6] << 8 | ulid->data[7]);
+  const uint64_t lo = load_be64(ulid->data + 8);
+  size_t first = 0, count = column->count;
+  while (count > 0) {
+    size_t half = count / 2;
+    if (compare_row(column, first + half, time_ms, hi, lo) < 0) {
+      first += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  return first;
+}
+
+size_t ULID_Column_TimeLowerBound(const ULID_Column *column,
+                                  const uint64_t time_ms) {
+  size_t first = 0, count = column->count;
+  while (count > 0) {
+    size_t half = count / 2;
+    if (column->time_ms[first + half] < time_ms) {
+      first += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  return first;
+}
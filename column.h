@@ -0,0 +1,13 @@
+#pragma once
+
+/*
+ * Columns of ULIDs, stored as a structure of arrays, see ULID_Column.
+ *
+ * Scans that only need the time read 8 bytes per ULID instead of 16, from an
+ * array of plain integers which the time kernels (min / max) process several
+ * at a time with SIMD, see dispatch.h.  Converting from an array of ULIDs
+ * extracts all times with SIMD too: each time is a 6-byte big-endian prefix,
+ * so a byte shuffle swaps it into a 64-bit lane.
+ */
+
+#include "dispatch.h"
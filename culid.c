@@ -1,46 +1,76 @@
 #include "ulid.h"
+#include <fcntl.h>
 #include <getopt.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
-static void print_ulids(ULID_Factory *uf, unsigned n);
+static volatile sig_atomic_t stopped = 0;
+
+static void stop(int signal);
+static int run_daemon(const char *path, const ULID_FactoryConfig *config);
+static int print_ulids(ULID_Factory *uf, ULID_LeaseClient *client,
+                       unsigned n);
 static void show_help(const char *prog);
+static int scan_main(const char *prog, int argc, char *argv[]);
+static void show_scan_help(const char *prog);
+static int verify_main(const char *prog, int argc, char *argv[]);
+static void show_verify_help(const char *prog);
 static uint8_t get_byte(const char *txt, unsigned *pos);
 
 int main(int argc, char *argv[]) {
   static struct option long_options[] = {
       {"rand", no_argument, 0, 'r'},
+      {"philox", no_argument, 0, 'p'},
       {"seed", required_argument, 0, 's'},
       {"entropy", required_argument, 0, 'e'},
       {"time", required_argument, 0, 't'},
+      {"daemon", required_argument, 0, 'd'},
+      {"lease", required_argument, 0, 'l'},
       {"help", no_argument, 0, 'h'},
       {0, 0, 0, 0},
   };
   const char *prog = argv[0];
-  ULID_Factory uf;
-  ULID_Factory_Default(&uf);
+  if (argc > 1 && strcmp(argv[1], "scan") == 0) {
+    return scan_main(prog, argc - 1, argv + 1);
+  }
+  if (argc > 1 && strcmp(argv[1], "verify") == 0) {
+    return verify_main(prog, argc - 1, argv + 1);
+  }
+  const char *daemon_path = 0;
+  const char *lease_path = 0;
+  uint8_t entropy[ULID_BYTES_ENTROPY] = {0};
+  ULID_FactoryConfig config;
+  memset(&config, 0, sizeof(config));
 
   int option = 0;
-  while ((option = getopt_long(argc, argv, ":rs:e:t:h", long_options, 0)) !=
-         -1) {
+  while ((option = getopt_long(argc, argv, ":rps:e:t:d:l:h", long_options,
+                               0)) != -1) {
     switch (option) {
     case 'r':
 #if 0
       printf("Using entropy from rand/srand\n");
 #endif
-      ULID_Factory_SetEntropyKind(&uf, ULID_ENTROPY_RAND);
+      config.kind = ULID_ENTROPY_RAND;
+      break;
+    case 'p':
+      config.kind = ULID_ENTROPY_PHILOX;
       break;
     case 's': {
       uint32_t seed = atoi(optarg);
 #if 0
       printf("Using seed [%u]\n", seed);
 #endif
-      ULID_Factory_SetEntropySeed(&uf, seed);
+      config.seed = seed;
       break;
     }
     case 'e': {
       unsigned pos = 0;
-      uint8_t entropy[ULID_BYTES_ENTROPY] = {0};
       for (unsigned e = 0; e < ULID_BYTES_ENTROPY; ++e) {
         entropy[e] = get_byte(optarg, &pos);
       }
@@ -52,14 +82,20 @@ int main(int argc, char *argv[]) {
       }
       printf("\n");
 #endif
-      ULID_Factory_SetEntropy(&uf, entropy);
+      config.entropy = entropy;
       break;
     }
     case 't':
 #if 0
       printf("Using time [%s]\n", optarg);
 #endif
-      ULID_Factory_SetTime(&uf, atoi(optarg));
+      config.time_ms = atoi(optarg);
+      break;
+    case 'd':
+      daemon_path = optarg;
+      break;
+    case 'l':
+      lease_path = optarg;
       break;
     case 'h':
       show_help(prog);
@@ -78,42 +114,474 @@ int main(int argc, char *argv[]) {
   }
   argc -= optind;
   argv += optind;
+  if (daemon_path) {
+    return run_daemon(daemon_path, &config);
+  }
+
+  ULID_Factory uf;
+  ULID_Factory_Init(&uf, &config);
+  ULID_LeaseClient *client = 0;
+  if (lease_path) {
+    client = ULID_LeaseClient_Open(lease_path);
+    if (!client) {
+      perror("ERROR: could not connect to lease daemon");
+      return 1;
+    }
+  }
+  int ok = 1;
   if (argc <= 0) {
-    print_ulids(&uf, 1);
+    ok = print_ulids(&uf, client, 1);
   } else {
-    for (int p = 0; p < argc; ++p) {
+    for (int p = 0; ok && p < argc; ++p) {
       unsigned n = atoi(argv[p]);
-      print_ulids(&uf, n);
+      ok = print_ulids(&uf, client, n);
     }
   }
+  ULID_LeaseClient_Close(client);
+  if (!ok) {
+    perror("ERROR: lost lease daemon");
+    return 1;
+  }
+  return 0;
+}
+
+static void stop(int signal) {
+  (void)signal;
+  stopped = 1;
+}
+
+static int run_daemon(const char *path, const ULID_FactoryConfig *config) {
+  ULID_LeaseServer *server = ULID_LeaseServer_Open(path, config);
+  if (!server) {
+    perror("ERROR: could not start lease daemon");
+    return 1;
+  }
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = stop;
+  sigaction(SIGINT, &action, 0);
+  sigaction(SIGTERM, &action, 0);
+  int rc = 0;
+  while (!stopped && rc >= 0) {
+    rc = ULID_LeaseServer_Serve(server, 100);
+  }
+  ULID_LeaseServer_Close(server);
+  if (rc < 0) {
+    perror("ERROR: lease daemon failed");
+    return 1;
+  }
   return 0;
 }
 
-static void print_ulids(ULID_Factory *uf, unsigned n) {
+static int print_ulids(ULID_Factory *uf, ULID_LeaseClient *client,
+                       unsigned n) {
+  static const char Head[] = "ULID: [";
+  char line[sizeof(Head) - 1 + ULID_BYTES_FORMATTED + 2];
+  memcpy(line, Head, sizeof(Head) - 1);
   for (unsigned p = 0; p < n; ++p) {
     ULID ulid;
-    ULID_Create(uf, &ulid);
+    if (client) {
+      if (!ULID_LeaseClient_Create(client, &ulid)) {
+        return 0;
+      }
+    } else {
+      ULID_Create(uf, &ulid);
+    }
+    char *end = ULID_ToChars(line + sizeof(Head) - 1, line + sizeof(line),
+                             &ulid, 0, ULID_FORMAT_UPPERCASE);
+    *end++ = ']';
+    *end++ = '\n';
+    fwrite(line, 1, end - line, stdout);
+  }
+  return 1;
+}
+
+typedef struct ScanOptions {
+  uint64_t min_ms;
+  uint64_t max_ms;
+  int offsets;  // print offsets instead of ULIDs
+  int prefixed; // prefix each line with the file name
+} ScanOptions;
+
+// Return the number of bytes scanned, or -1 if the file could not be read.
+static long long scan_file(const char *path, const ScanOptions *options,
+                           unsigned long long *found) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  size_t size = st.st_size;
+  if (size == 0) {
+    close(fd);
+    return 0;
+  }
+  const char *text =
+      (const char *)mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (text == MAP_FAILED) {
+    return -1;
+  }
+  madvise((void *)text, size, MADV_SEQUENTIAL);
+
+  enum {
+    BATCH = 1024,
+  };
+  static ULID_ScanMatch matches[BATCH];
+  size_t pos = 0;
+  while (pos < size) {
+    size_t n = ULID_Scan(text, size, &pos, options->min_ms, options->max_ms,
+                         matches, BATCH);
+    for (size_t m = 0; m < n; ++m) {
+      if (options->prefixed) {
+        printf("%s:", path);
+      }
+      if (options->offsets) {
+        printf("%llu\n", (unsigned long long)matches[m].offset);
+      } else {
+        char line[ULID_BYTES_FORMATTED + 1];
+        ULID_Format(&matches[m].ulid, line);
+        line[ULID_BYTES_FORMATTED] = '\n';
+        fwrite(line, 1, sizeof(line), stdout);
+      }
+    }
+    *found += n;
+  }
+  munmap((void *)text, size);
+  return (long long)size;
+}
+
+static int scan_main(const char *prog, int argc, char *argv[]) {
+  static struct option long_options[] = {
+      {"from", required_argument, 0, 'f'},
+      {"to", required_argument, 0, 't'},
+      {"offsets", no_argument, 0, 'o'},
+      {"stats", no_argument, 0, 's'},
+      {"help", no_argument, 0, 'h'},
+      {0, 0, 0, 0},
+  };
+  ScanOptions options = {0, UINT64_MAX, 0, 0};
+  int stats = 0;
+  int option = 0;
+  while ((option = getopt_long(argc, argv, ":f:t:osh", long_options, 0)) !=
+         -1) {
+    switch (option) {
+    case 'f':
+      options.min_ms = strtoull(optarg, 0, 10);
+      break;
+    case 't':
+      options.max_ms = strtoull(optarg, 0, 10);
+      break;
+    case 'o':
+      options.offsets = 1;
+      break;
+    case 's':
+      stats = 1;
+      break;
+    case 'h':
+      show_scan_help(prog);
+      return 1;
+    case ':':
+      fprintf(stderr, "ERROR: missing argument for option %s\n\n",
+              argv[optind - 1]);
+      show_scan_help(prog);
+      return 1;
+    case '?':
+    default:
+      fprintf(stderr, "ERROR: unknown option %s\n\n", argv[optind - 1]);
+      show_scan_help(prog);
+      return 1;
+    }
+  }
+  argc -= optind;
+  argv += optind;
+  if (argc <= 0) {
+    fprintf(stderr, "ERROR: no files to scan\n\n");
+    show_scan_help(prog);
+    return 1;
+  }
+  options.prefixed = argc > 1;
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  unsigned long long bytes = 0, found = 0;
+  int rc = 0;
+  for (int p = 0; p < argc; ++p) {
+    long long scanned = scan_file(argv[p], &options, &found);
+    if (scanned < 0) {
+      fprintf(stderr, "ERROR: could not read %s\n", argv[p]);
+      rc = 1;
+      continue;
+    }
+    bytes += scanned;
+  }
+  fflush(stdout);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (stats) {
+    double secs =
+        (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%llu ULIDs in %llu bytes, %.3f s, %.2f GB/s (%s)\n",
+            found, bytes, secs, secs > 0 ? bytes / secs / 1e9 : 0.0,
+            ULID_CpuLevelName(ULID_GetCpuLevel()));
+  }
+  return rc;
+}
+
+static void show_scan_help(const char *prog) {
+  fprintf(stderr, "%s scan -- Find the ULIDs in files\n", prog);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Usage: %s scan [options] file...\n", prog);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "  --from ...    | -f  only ULIDs with a time (in ms) from "
+                  "this one\n");
+  fprintf(stderr, "  --to ...      | -t  only ULIDs with a time (in ms) up to "
+                  "this one\n");
+  fprintf(stderr, "  --offsets     | -o  print byte offsets instead of "
+                  "ULIDs\n");
+  fprintf(stderr, "  --stats       | -s  print throughput to stderr\n");
+  fprintf(stderr, "  --help        | -h  show this help\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Examples:\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "  # print all ULIDs in a log file\n");
+  fprintf(stderr, "  %s scan app.log\n", prog);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "  # print the offsets of ULIDs from one minute\n");
+  fprintf(stderr, "  %s scan --offsets --from 1733505180000 "
+                  "--to 1733505239999 app.log\n", prog);
+}
+
+typedef struct VerifyOptions {
+  uint64_t min_ms;
+  uint64_t max_ms;
+  unsigned threads;
+  int binary; // 16-byte ULIDs instead of text
+} VerifyOptions;
+
+static void print_report(const char *path, const ULID_VerifyReport *report,
+                         const size_t size, const double secs) {
+  static const char *Kinds[ULID_VERIFY_KINDS] = {
+      "unsorted",
+      "duplicate",
+      "out of window",
+  };
+  uint64_t violations = 0;
+  for (unsigned k = 0; k < ULID_VERIFY_KINDS; ++k) {
+    violations += report->violations[k];
+  }
+  printf("%s: %llu ULIDs, ", path, (unsigned long long)report->count);
+  if (violations == 0) {
+    printf("all strictly increasing and within the window\n");
+  } else {
+    printf("%llu violations (%llu unsorted, %llu duplicate, "
+           "%llu out of window)\n",
+           (unsigned long long)violations,
+           (unsigned long long)report->violations[ULID_VERIFY_UNSORTED],
+           (unsigned long long)report->violations[ULID_VERIFY_DUPLICATE],
+           (unsigned long long)report->violations[ULID_VERIFY_TIME]);
+  }
+  if (report->count > 0) {
+    printf("  times: %llu to %llu ms\n", (unsigned long long)report->min_ms,
+           (unsigned long long)report->max_ms);
+    printf("  ms: %llu, %.1f ULIDs per ms on average, %llu at most\n",
+           (unsigned long long)report->distinct_ms,
+           (double)report->count / report->distinct_ms,
+           (unsigned long long)report->max_per_ms);
+    printf("  ULIDs per ms:");
+    for (unsigned j = 0; j < ULID_VERIFY_PER_MS_LOG2; ++j) {
+      if (report->per_ms[j]) {
+        printf(" %llu%s: %llu", 1ull << j,
+               j + 1 < ULID_VERIFY_PER_MS_LOG2 ? "+" : "++",
+               (unsigned long long)report->per_ms[j]);
+      }
+    }
+    printf("\n");
+    printf("  longest chain, each ULID one more than the last: %llu\n",
+           (unsigned long long)report->max_chain);
+  }
+  for (uint64_t v = 0; v < report->first_count; ++v) {
+    const ULID_VerifyViolation *violation = &report->first[v];
     char txt[ULID_BYTES_FORMATTED];
-    ULID_Format(&ulid, txt);
-    printf("ULID: [%.*s]\n", ULID_BYTES_FORMATTED, txt);
+    ULID_Format(&violation->ulid, txt);
+    printf("  ULID #%llu at byte %llu: %.*s is %s\n",
+           (unsigned long long)violation->index,
+           (unsigned long long)violation->offset, ULID_BYTES_FORMATTED, txt,
+           Kinds[violation->kind]);
+  }
+  if (secs > 0) {
+    printf("  %.3f s, %.2f GB/s\n", secs, size / secs / 1e9);
   }
 }
 
+// Return 1 if the file was verified with no violations, 0 if there were
+// some, -1 if the file could not be read.
+static int verify_file(const char *path, const VerifyOptions *options) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 ||
+      (options->binary && st.st_size % sizeof(ULID) != 0)) {
+    close(fd);
+    return -1;
+  }
+  size_t size = st.st_size;
+  const char *data = 0;
+  if (size > 0) {
+    data = (const char *)mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  ULID_VerifyReport report;
+  int ok = options->binary
+               ? ULID_Verify((const ULID *)data, size / sizeof(ULID),
+                             options->min_ms, options->max_ms,
+                             options->threads, &report)
+               : ULID_VerifyText(data, size, options->min_ms,
+                                 options->max_ms, options->threads, &report);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double secs =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  print_report(path, &report, size, secs);
+  if (size > 0) {
+    munmap((void *)data, size);
+  }
+  return ok;
+}
+
+static int verify_main(const char *prog, int argc, char *argv[]) {
+  static struct option long_options[] = {
+      {"from", required_argument, 0, 'f'},
+      {"to", required_argument, 0, 't'},
+      {"binary", no_argument, 0, 'b'},
+      {"threads", required_argument, 0, 'j'},
+      {"help", no_argument, 0, 'h'},
+      {0, 0, 0, 0},
+  };
+  VerifyOptions options = {0, UINT64_MAX, 0, 0};
+  int option = 0;
+  while ((option = getopt_long(argc, argv, ":f:t:bj:h", long_options, 0)) !=
+         -1) {
+    switch (option) {
+    case 'f':
+      options.min_ms = strtoull(optarg, 0, 10);
+      break;
+    case 't':
+      options.max_ms = strtoull(optarg, 0, 10);
+      break;
+    case 'b':
+      options.binary = 1;
+      break;
+    case 'j':
+      options.threads = strtoul(optarg, 0, 10);
+      break;
+    case 'h':
+      show_verify_help(prog);
+      return 1;
+    case ':':
+      fprintf(stderr, "ERROR: missing argument for option %s\n\n",
+              argv[optind - 1]);
+      show_verify_help(prog);
+      return 1;
+    case '?':
+    default:
+      fprintf(stderr, "ERROR: unknown option %s\n\n", argv[optind - 1]);
+      show_verify_help(prog);
+      return 1;
+    }
+  }
+  argc -= optind;
+  argv += optind;
+  if (argc <= 0) {
+    fprintf(stderr, "ERROR: no files to verify\n\n");
+    show_verify_help(prog);
+    return 1;
+  }
+
+  int rc = 0;
+  for (int p = 0; p < argc; ++p) {
+    int ok = verify_file(argv[p], &options);
+    if (ok < 0) {
+      fprintf(stderr, "ERROR: could not read %s%s\n", argv[p],
+              options.binary ? " as 16-byte ULIDs" : "");
+    }
+    if (ok != 1) {
+      rc = 1;
+    }
+  }
+  return rc;
+}
+
+static void show_verify_help(const char *prog) {
+  fprintf(stderr, "%s verify -- Check that the ULIDs in files are strictly "
+                  "increasing\n", prog);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Usage: %s verify [options] file...\n", prog);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Each file is checked on its own, in parallel slices, for "
+                  "ULIDs not greater\n");
+  fprintf(stderr, "than the one before them (unsorted or duplicate) and "
+                  "times outside the\n");
+  fprintf(stderr, "window.  Statistics and the first violations are "
+                  "printed; the exit status\n");
+  fprintf(stderr, "is 1 if any file has violations or cannot be read.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "  --from ...    | -f  expect times (in ms) from this "
+                  "one\n");
+  fprintf(stderr, "  --to ...      | -t  expect times (in ms) up to this "
+                  "one\n");
+  fprintf(stderr, "  --binary      | -b  files hold 16-byte ULIDs, not "
+                  "text\n");
+  fprintf(stderr, "  --threads ... | -j  threads to use (default: one per "
+                  "CPU)\n");
+  fprintf(stderr, "  --help        | -h  show this help\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Examples:\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "  # verify a file with one ULID per line\n");
+  fprintf(stderr, "  %s verify ids.txt\n", prog);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "  # verify a binary dump, with times within one day\n");
+  fprintf(stderr, "  %s verify --binary --from 1733443200000 "
+                  "--to 1733529599999 ids.bin\n", prog);
+}
+
 static void show_help(const char *prog) {
   fprintf(stderr, "%s -- Utility to generate ULIDs\n", prog);
   fprintf(stderr, "\n");
   fprintf(stderr, "Usage: %s [options] number...\n", prog);
+  fprintf(stderr, "       %s scan [options] file...\n", prog);
+  fprintf(stderr, "       %s verify [options] file...\n", prog);
   fprintf(stderr, "\n");
   fprintf(stderr, "Options:\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "  --rand        | -r  use rand / srand for entropy "
                   "(default: use Mersenne Twister)\n");
+  fprintf(stderr, "  --philox      | -p  use Philox (counter-based) for entropy "
+                  "(default: use Mersenne Twister)\n");
   fprintf(stderr, "  --seed ...    | -s  use specified seed for entropy "
                   "(default: use random seed)\n");
   fprintf(stderr, "  --entropy ... | -e  use specified values for entropy "
                   "(default: use random entropy)\n");
   fprintf(stderr, "  --time ...    | -t  use specified time (in ms) "
                   "(default: use current time)\n");
+  fprintf(stderr, "  --daemon ...  | -d  run a lease daemon on the given "
+                  "Unix socket\n");
+  fprintf(stderr, "  --lease ...   | -l  get ULIDs from the lease daemon on "
+                  "the given socket\n");
   fprintf(stderr, "  --help        | -h  show this help\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "Examples:\n");
@@ -127,11 +595,18 @@ static void show_help(const char *prog) {
   fprintf(stderr, "  # generate 9 ULIDs using a given seed for entropy\n");
   fprintf(stderr, "  %s --seed 12345 9\n", prog);
   fprintf(stderr, "\n");
+  fprintf(stderr, "  # generate 9 ULIDs using Philox with a given seed\n");
+  fprintf(stderr, "  %s --philox --seed 12345 9\n", prog);
+  fprintf(stderr, "\n");
   fprintf(stderr, "  # generate 9 ULIDs using specified values for entropy\n");
   fprintf(stderr, "  %s --entropy deadbeefc0ffeebabe11 9\n", prog);
   fprintf(stderr, "\n");
   fprintf(stderr, "  # generate 9 ULIDs using specified time (in ms)\n");
   fprintf(stderr, "  %s --time 3344556677 9\n", prog);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "  # run a lease daemon, then get 9 ULIDs from it\n");
+  fprintf(stderr, "  %s --daemon /run/culid.sock &\n", prog);
+  fprintf(stderr, "  %s --lease /run/culid.sock 9\n", prog);
 }
 
 static unsigned h2d(char c) {
@@ -0,0 +1,112 @@
+#include "dispatch.h"
+#include "simd.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *LevelNames[ULID_CPU_LEVELS] = {
+    "scalar",
+    "sse4.2",
+    "avx2",
+    "avx512",
+};
+
+static const ULID_Kernels Kernels[ULID_CPU_LEVELS] = {
+    {
+        ulid_format_scalar,
+        ulid_parse_scalar,
+        ulid_compare_scalar,
+        mtwister_twist_scalar,
+        ulid_classify_scalar,
+        ulid_get_times_scalar,
+        ulid_time_range_scalar,
+    },
+#if ULID_KERNELS_X86
+    {
+        ulid_format_sse42,
+        ulid_parse_sse42,
+        ulid_compare_sse42,
+        mtwister_twist_sse42,
+        ulid_classify_sse42,
+        ulid_get_times_sse42,
+        ulid_time_range_sse42,
+    },
+    {
+        ulid_format_avx2,
+        ulid_parse_avx2,
+        ulid_compare_sse42, // 16 bytes fit in one SSE register
+        mtwister_twist_avx2,
+        ulid_classify_avx2,
+        ulid_get_times_avx2,
+        ulid_time_range_avx2,
+    },
+    {
+        ulid_format_avx512,
+        ulid_parse_avx512,
+        ulid_compare_sse42, // 16 bytes fit in one SSE register
+        mtwister_twist_avx512,
+        ulid_classify_avx512,
+        ulid_get_times_avx512,
+        ulid_time_range_avx512,
+    },
+#endif
+};
+
+const ULID_Kernels *ulid_kernels_active = 0;
+
+static enum ULID_CpuLevel detect_cpu_level(void) {
+#if ULID_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512vl")) {
+    return ULID_CPU_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return ULID_CPU_AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return ULID_CPU_SSE42;
+  }
+#endif
+  return ULID_CPU_SCALAR;
+}
+
+static enum ULID_CpuLevel install_cpu_level(enum ULID_CpuLevel level) {
+  enum ULID_CpuLevel supported = detect_cpu_level();
+  if (level > supported) {
+    level = supported;
+  }
+  __atomic_store_n(&ulid_kernels_active, &Kernels[level], __ATOMIC_RELEASE);
+  return level;
+}
+
+const ULID_Kernels *ulid_kernels_resolve(void) {
+  // Resolving is idempotent, so it does not matter if several threads race
+  // here -- they will all install the same kernels.
+  enum ULID_CpuLevel level = ULID_CPU_AVX512;
+  const char *forced = getenv("ULID_CPU_LEVEL");
+  if (forced) {
+    for (unsigned l = 0; l < ULID_CPU_LEVELS; ++l) {
+      if (strcmp(forced, LevelNames[l]) == 0) {
+        level = (enum ULID_CpuLevel)l;
+        break;
+      }
+    }
+  }
+  install_cpu_level(level);
+  return ulid_kernels_active;
+}
+
+enum ULID_CpuLevel ULID_GetCpuLevel(void) {
+  return (enum ULID_CpuLevel)(ulid_kernels() - Kernels);
+}
+
+enum ULID_CpuLevel ULID_SetCpuLevel(const enum ULID_CpuLevel level) {
+  return install_cpu_level(level);
+}
+
+const char *ULID_CpuLevelName(const enum ULID_CpuLevel level) {
+  if ((unsigned)level >= ULID_CPU_LEVELS) {
+    return "unknown";
+  }
+  return LevelNames[level];
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+/*
+ * Runtime dispatch of the hot kernels to the best variant for this CPU.
+ *
+ * The CPU level is detected (via cpuid) the first time any kernel is used,
+ * and the matching table of function pointers is installed; after that,
+ * calling a kernel costs just one extra indirect call.
+ *
+ * The level can be forced by setting envvar ULID_CPU_LEVEL to one of
+ * "scalar", "sse4.2", "avx2" or "avx512", or by calling ULID_SetCpuLevel().
+ */
+
+#include "mtwister.h"
+#include "ulid.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ULID_KERNELS_X86 1
+#else
+#define ULID_KERNELS_X86 0
+#endif
+
+// ULID_Scan() classifies text in blocks of this many chars, one bit each.
+#define ULID_SCAN_BLOCK 64
+
+// One variant of each of the hot kernels.
+typedef struct ULID_Kernels {
+  unsigned (*format)(const ULID *ulid, char buf[ULID_BYTES_FORMATTED]);
+  unsigned (*parse)(ULID *ulid, const char str[ULID_BYTES_FORMATTED]);
+  int (*compare)(const ULID *l, const ULID *r);
+  void (*twist)(MTwister *mt);
+  // For each of the blocks of ULID_SCAN_BLOCK chars in text, store a mask of
+  // the chars in the ULID alphabet in alnum, and of the chars that can start
+  // a ULID in lead.
+  void (*classify)(const char *text, size_t blocks, uint64_t *alnum,
+                   uint64_t *lead);
+  // Store the time of each of n ULIDs.
+  void (*get_times)(const ULID *ulids, size_t n, uint64_t *times_ms);
+  // Find the minimum and maximum of n >= 1 times.
+  void (*time_range)(const uint64_t *times_ms, size_t n, uint64_t *min_ms,
+                     uint64_t *max_ms);
+} ULID_Kernels;
+
+// The kernels in use; NULL until the first call to ulid_kernels().
+extern const ULID_Kernels *ulid_kernels_active;
+
+// Detect the CPU level and install its kernels.
+const ULID_Kernels *ulid_kernels_resolve(void);
+
+static inline const ULID_Kernels *ulid_kernels(void) {
+  const ULID_Kernels *kernels =
+      __atomic_load_n(&ulid_kernels_active, __ATOMIC_ACQUIRE);
+  if (!kernels) {
+    kernels = ulid_kernels_resolve();
+  }
+  return kernels;
+}
+
+// Scalar variants, which work everywhere.
+unsigned ulid_format_scalar(const ULID *ulid, char buf[ULID_BYTES_FORMATTED]);
+unsigned ulid_parse_scalar(ULID *ulid, const char str[ULID_BYTES_FORMATTED]);
+int ulid_compare_scalar(const ULID *l, const ULID *r);
+void mtwister_twist_scalar(MTwister *mt);
+void ulid_classify_scalar(const char *text, size_t blocks, uint64_t *alnum,
+                          uint64_t *lead);
+void ulid_get_times_scalar(const ULID *ulids, size_t n, uint64_t *times_ms);
+void ulid_time_range_scalar(const uint64_t *times_ms, size_t n,
+                            uint64_t *min_ms, uint64_t *max_ms);
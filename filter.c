@@ -0,0 +1,511 @@
+#include "filter.h"
+#include "ulid.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A Bloom block is a cache line of 8 words; each ULID sets one bit per word,
+// picked by 6 bits of its tag.
+#define BLOCK_WORDS 8
+
+// A cuckoo bucket is a word of 4 fingerprints of 16 bits, 0 meaning empty.
+#define BUCKET_SLOTS 4
+#define BUCKET_LANES 0x0001000100010001ull
+
+// Cuckoo filters are sized for this load, which 4-slot buckets reach well
+// before insertions start failing.
+#define CUCKOO_LOAD 0.95
+
+// Evictions tried before a cuckoo filter gives up and keeps a victim.
+#define CUCKOO_MAX_KICKS 500
+
+// Bits per ULID of a Bloom filter, unless told otherwise: about 0.1% false
+// positives.
+#define BLOOM_BITS_PER_ULID 16
+
+// Keys looked up (or added) together, their slots prefetched first.
+#define BATCH 16
+
+struct ULID_BloomFilter {
+  ULID_FilterHeader *header; // followed by the blocks, as in a file
+  uint64_t *blocks;
+  uint64_t mask;             // blocks - 1
+  size_t size;               // of the whole region
+  int mapped;                // by ULID_BloomFilter_Open(), else allocated
+};
+
+struct ULID_CuckooFilter {
+  ULID_FilterHeader *header; // followed by the buckets, as in a file
+  uint64_t *buckets;
+  uint64_t mask;             // buckets - 1
+  size_t size;               // of the whole region
+  int mapped;                // by ULID_CuckooFilter_Open(), else allocated
+};
+
+typedef struct FilterKey {
+  uint64_t index;
+  uint64_t tag; // 48 bits
+} FilterKey;
+
+static inline uint64_t load_be64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+// The finalizer of MurmurHash3.
+static inline uint64_t mix64(uint64_t z) {
+  z = (z ^ (z >> 33)) * 0xff51afd7ed558ccdull;
+  z = (z ^ (z >> 33)) * 0xc4ceb9fe1a85ec53ull;
+  return z ^ (z >> 33);
+}
+
+static inline FilterKey make_key(const uint32_t keying, const ULID *ulid) {
+  uint64_t hi = load_be64(ulid->data);     // time, top 16 bits of entropy
+  uint64_t lo = load_be64(ulid->data + 8); // low 64 bits of entropy
+  FilterKey key;
+  if (keying == ULID_FILTER_ENTROPY) {
+    key.index = lo;
+    key.tag = (lo >> 32) << 16 | (hi & 0xffff);
+  } else {
+    key.index = mix64(hi ^ mix64(lo));
+    key.tag = mix64(key.index) >> 16;
+  }
+  return key;
+}
+
+enum ULID_FilterKeying ULID_FilterKeyingFor(const ULID_FactoryConfig *config) {
+  return config && (config->kind == ULID_ENTROPY_RAND || config->seed ||
+                    config->entropy || config->submillisecond)
+             ? ULID_FILTER_HASH
+             : ULID_FILTER_ENTROPY;
+}
+
+/*
+ * Regions: allocated, saved, mapped
+ */
+
+static unsigned log2_at_least(uint64_t n) {
+  unsigned log2 = 0;
+  while (log2 < ULID_FILTER_MAX_LOG2_SLOTS && ((uint64_t)1 << log2) < n) {
+    ++log2;
+  }
+  return log2;
+}
+
+static ULID_FilterHeader *new_region(const uint32_t magic,
+                                     const enum ULID_FilterKeying keying,
+                                     const unsigned log2_slots,
+                                     const size_t slot_size, size_t *size) {
+  *size = sizeof(ULID_FilterHeader) + (slot_size << log2_slots);
+  ULID_FilterHeader *header = (ULID_FilterHeader *)aligned_alloc(64, *size);
+  if (!header) {
+    return 0;
+  }
+  memset(header, 0, *size);
+  header->magic = magic;
+  header->keying = keying;
+  header->log2_slots = log2_slots;
+  return header;
+}
+
+static int save_region(const ULID_FilterHeader *header, const size_t size,
+                       const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return 0;
+  }
+  const char *p = (const char *)header;
+  size_t left = size;
+  while (left > 0) {
+    ssize_t wrote = write(fd, p, left);
+    if (wrote < 0 && errno == EINTR) {
+      continue;
+    }
+    if (wrote <= 0) {
+      int saved = errno;
+      close(fd);
+      errno = saved;
+      return 0;
+    }
+    p += wrote;
+    left -= (size_t)wrote;
+  }
+  return close(fd) == 0;
+}
+
+static ULID_FilterHeader *map_region(const char *path, const uint32_t magic,
+                                     const size_t slot_size,
+                                     const int writable, size_t *size) {
+  int fd = open(path, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0) {
+    if ((size_t)st.st_size < sizeof(ULID_FilterHeader)) {
+      errno = EINVAL;
+    } else {
+      map = mmap(0, (size_t)st.st_size,
+                 writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+                 fd, 0);
+    }
+  }
+  int saved = errno;
+  close(fd);
+  if (map == MAP_FAILED) {
+    errno = saved;
+    return 0;
+  }
+  ULID_FilterHeader *header = (ULID_FilterHeader *)map;
+  if (header->magic != magic ||
+      (header->keying != ULID_FILTER_ENTROPY &&
+       header->keying != ULID_FILTER_HASH) ||
+      header->log2_slots > ULID_FILTER_MAX_LOG2_SLOTS ||
+      (size_t)st.st_size !=
+          sizeof(ULID_FilterHeader) + (slot_size << header->log2_slots)) {
+    munmap(map, (size_t)st.st_size);
+    errno = EINVAL;
+    return 0;
+  }
+  *size = (size_t)st.st_size;
+  return header;
+}
+
+static void free_region(ULID_FilterHeader *header, const size_t size,
+                        const int mapped) {
+  if (mapped) {
+    munmap(header, size);
+  } else {
+    free(header);
+  }
+}
+
+/*
+ * Bloom filter
+ */
+
+static ULID_BloomFilter *new_bloom(ULID_FilterHeader *header,
+                                   const size_t size, const int mapped) {
+  ULID_BloomFilter *filter =
+      (ULID_BloomFilter *)malloc(sizeof(ULID_BloomFilter));
+  if (!filter) {
+    free_region(header, size, mapped);
+    return 0;
+  }
+  filter->header = header;
+  filter->blocks = (uint64_t *)(header + 1);
+  filter->mask = ((uint64_t)1 << header->log2_slots) - 1;
+  filter->size = size;
+  filter->mapped = mapped;
+  return filter;
+}
+
+ULID_BloomFilter *ULID_BloomFilter_New(const size_t capacity,
+                                       const unsigned bits_per_ulid,
+                                       const enum ULID_FilterKeying keying) {
+  uint64_t bits = (uint64_t)capacity *
+                  (bits_per_ulid ? bits_per_ulid : BLOOM_BITS_PER_ULID);
+  uint64_t blocks = (bits + 64 * BLOCK_WORDS - 1) / (64 * BLOCK_WORDS);
+  size_t size;
+  ULID_FilterHeader *header =
+      new_region(ULID_BLOOM_MAGIC, keying, log2_at_least(blocks),
+                 BLOCK_WORDS * sizeof(uint64_t), &size);
+  return header ? new_bloom(header, size, 0) : 0;
+}
+
+ULID_BloomFilter *ULID_BloomFilter_Open(const char *path, const int writable) {
+  size_t size;
+  ULID_FilterHeader *header =
+      map_region(path, ULID_BLOOM_MAGIC, BLOCK_WORDS * sizeof(uint64_t),
+                 writable, &size);
+  return header ? new_bloom(header, size, 1) : 0;
+}
+
+void ULID_BloomFilter_Free(ULID_BloomFilter *filter) {
+  if (filter) {
+    free_region(filter->header, filter->size, filter->mapped);
+    free(filter);
+  }
+}
+
+int ULID_BloomFilter_Save(const ULID_BloomFilter *filter, const char *path) {
+  return save_region(filter->header, filter->size, path);
+}
+
+static inline uint64_t *bloom_block(const ULID_BloomFilter *filter,
+                                    const FilterKey key) {
+  return filter->blocks + (key.index & filter->mask) * BLOCK_WORDS;
+}
+
+static inline void block_add(uint64_t *block, const uint64_t tag) {
+  for (unsigned j = 0; j < BLOCK_WORDS; ++j) {
+    block[j] |= 1ull << (tag >> (6 * j) & 63);
+  }
+}
+
+static inline int block_contains(const uint64_t *block, const uint64_t tag) {
+  uint64_t missing = 0;
+  for (unsigned j = 0; j < BLOCK_WORDS; ++j) {
+    missing |= ~block[j] & 1ull << (tag >> (6 * j) & 63);
+  }
+  return missing == 0;
+}
+
+void ULID_BloomFilter_Add(ULID_BloomFilter *filter, const ULID *ulid) {
+  FilterKey key = make_key(filter->header->keying, ulid);
+  block_add(bloom_block(filter, key), key.tag);
+  ++filter->header->count;
+}
+
+void ULID_BloomFilter_AddMany(ULID_BloomFilter *filter, const ULID *ulids,
+                              const size_t n) {
+  uint32_t keying = filter->header->keying;
+  FilterKey keys[BATCH];
+  for (size_t first = 0; first < n; first += BATCH) {
+    size_t batch = n - first < BATCH ? n - first : BATCH;
+    for (size_t j = 0; j < batch; ++j) {
+      keys[j] = make_key(keying, &ulids[first + j]);
+      __builtin_prefetch(bloom_block(filter, keys[j]), 1);
+    }
+    for (size_t j = 0; j < batch; ++j) {
+      block_add(bloom_block(filter, keys[j]), keys[j].tag);
+    }
+  }
+  filter->header->count += n;
+}
+
+int ULID_BloomFilter_Contains(const ULID_BloomFilter *filter,
+                              const ULID *ulid) {
+  FilterKey key = make_key(filter->header->keying, ulid);
+  return block_contains(bloom_block(filter, key), key.tag);
+}
+
+size_t ULID_BloomFilter_ContainsMany(const ULID_BloomFilter *filter,
+                                     const ULID *ulids, const size_t n,
+                                     uint8_t *found) {
+  uint32_t keying = filter->header->keying;
+  FilterKey keys[BATCH];
+  size_t total = 0;
+  for (size_t first = 0; first < n; first += BATCH) {
+    size_t batch = n - first < BATCH ? n - first : BATCH;
+    for (size_t j = 0; j < batch; ++j) {
+      keys[j] = make_key(keying, &ulids[first + j]);
+      __builtin_prefetch(bloom_block(filter, keys[j]));
+    }
+    for (size_t j = 0; j < batch; ++j) {
+      int in = block_contains(bloom_block(filter, keys[j]), keys[j].tag);
+      found[first + j] = (uint8_t)in;
+      total += in;
+    }
+  }
+  return total;
+}
+
+uint64_t ULID_BloomFilter_Count(const ULID_BloomFilter *filter) {
+  return filter->header->count;
+}
+
+/*
+ * Cuckoo filter
+ */
+
+static inline uint16_t fingerprint(const FilterKey key) {
+  uint16_t fp = (uint16_t)key.tag;
+  return fp ? fp : 1;
+}
+
+// The other bucket of a fingerprint; going from either one gives the other.
+static inline uint64_t other_bucket(const ULID_CuckooFilter *filter,
+                                    const uint64_t bucket,
+                                    const uint16_t fp) {
+  return (bucket ^ (uint64_t)fp * 0x5bd1e995u) & filter->mask;
+}
+
+static inline int bucket_has(const uint64_t bucket, const uint16_t fp) {
+  uint64_t x = bucket ^ fp * BUCKET_LANES; // a zero lane where fp is
+  return ((x - BUCKET_LANES) & ~x & BUCKET_LANES << 15) != 0;
+}
+
+static int bucket_put(uint64_t *bucket, const uint16_t fp) {
+  for (unsigned j = 0; j < BUCKET_SLOTS; ++j) {
+    if (!(*bucket >> (16 * j) & 0xffff)) {
+      *bucket |= (uint64_t)fp << (16 * j);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int bucket_take(uint64_t *bucket, const uint16_t fp) {
+  for (unsigned j = 0; j < BUCKET_SLOTS; ++j) {
+    if ((*bucket >> (16 * j) & 0xffff) == fp) {
+      *bucket &= ~(0xffffull << (16 * j));
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static ULID_CuckooFilter *new_cuckoo(ULID_FilterHeader *header,
+                                     const size_t size, const int mapped) {
+  ULID_CuckooFilter *filter =
+      (ULID_CuckooFilter *)malloc(sizeof(ULID_CuckooFilter));
+  if (!filter) {
+    free_region(header, size, mapped);
+    return 0;
+  }
+  filter->header = header;
+  filter->buckets = (uint64_t *)(header + 1);
+  filter->mask = ((uint64_t)1 << header->log2_slots) - 1;
+  filter->size = size;
+  filter->mapped = mapped;
+  return filter;
+}
+
+ULID_CuckooFilter *ULID_CuckooFilter_New(const size_t capacity,
+                                         const enum ULID_FilterKeying keying) {
+  uint64_t buckets = (uint64_t)(capacity / (BUCKET_SLOTS * CUCKOO_LOAD)) + 1;
+  size_t size;
+  ULID_FilterHeader *header =
+      new_region(ULID_CUCKOO_MAGIC, keying, log2_at_least(buckets),
+                 sizeof(uint64_t), &size);
+  return header ? new_cuckoo(header, size, 0) : 0;
+}
+
+ULID_CuckooFilter *ULID_CuckooFilter_Open(const char *path,
+                                          const int writable) {
+  size_t size;
+  ULID_FilterHeader *header =
+      map_region(path, ULID_CUCKOO_MAGIC, sizeof(uint64_t), writable, &size);
+  return header ? new_cuckoo(header, size, 1) : 0;
+}
+
+void ULID_CuckooFilter_Free(ULID_CuckooFilter *filter) {
+  if (filter) {
+    free_region(filter->header, filter->size, filter->mapped);
+    free(filter);
+  }
+}
+
+int ULID_CuckooFilter_Save(const ULID_CuckooFilter *filter,
+                           const char *path) {
+  return save_region(filter->header, filter->size, path);
+}
+
+// Put a fingerprint in one of its buckets, evicting others to their other
+// bucket if both are full.  If that goes on for too long, the fingerprint
+// last evicted is kept as the victim, and the filter is full.
+static void cuckoo_put(ULID_CuckooFilter *filter, uint64_t bucket,
+                       uint16_t fp) {
+  uint64_t *buckets = filter->buckets;
+  if (bucket_put(&buckets[bucket], fp)) {
+    return;
+  }
+  bucket = other_bucket(filter, bucket, fp);
+  for (unsigned kick = 0; kick < CUCKOO_MAX_KICKS; ++kick) {
+    if (bucket_put(&buckets[bucket], fp)) {
+      return;
+    }
+    // evict from a slot that varies with the bucket and the kick, so that
+    // evictions do not cycle between the same few fingerprints
+    unsigned slot = (unsigned)(bucket * 0x9e3779b97f4a7c15ull >> 62) ^ kick;
+    slot = 16 * (slot % BUCKET_SLOTS);
+    uint16_t evicted = (uint16_t)(buckets[bucket] >> slot);
+    buckets[bucket] ^= (uint64_t)(evicted ^ fp) << slot;
+    fp = evicted;
+    bucket = other_bucket(filter, bucket, fp);
+  }
+  filter->header->victim = fp;
+  filter->header->victim_bucket = bucket;
+}
+
+int ULID_CuckooFilter_Add(ULID_CuckooFilter *filter, const ULID *ulid) {
+  if (filter->header->victim) {
+    return 0;
+  }
+  FilterKey key = make_key(filter->header->keying, ulid);
+  cuckoo_put(filter, key.index & filter->mask, fingerprint(key));
+  ++filter->header->count;
+  return 1;
+}
+
+static inline int cuckoo_contains(const ULID_CuckooFilter *filter,
+                                  const uint64_t b1, const uint64_t b2,
+                                  const uint16_t fp) {
+  const ULID_FilterHeader *header = filter->header;
+  return bucket_has(filter->buckets[b1], fp) |
+         bucket_has(filter->buckets[b2], fp) |
+         (header->victim == fp &&
+          (header->victim_bucket == b1 || header->victim_bucket == b2));
+}
+
+int ULID_CuckooFilter_Contains(const ULID_CuckooFilter *filter,
+                               const ULID *ulid) {
+  FilterKey key = make_key(filter->header->keying, ulid);
+  uint16_t fp = fingerprint(key);
+  uint64_t b1 = key.index & filter->mask;
+  return cuckoo_contains(filter, b1, other_bucket(filter, b1, fp), fp);
+}
+
+size_t ULID_CuckooFilter_ContainsMany(const ULID_CuckooFilter *filter,
+                                      const ULID *ulids, const size_t n,
+                                      uint8_t *found) {
+  uint32_t keying = filter->header->keying;
+  uint64_t b1[BATCH], b2[BATCH];
+  uint16_t fps[BATCH];
+  size_t total = 0;
+  for (size_t first = 0; first < n; first += BATCH) {
+    size_t batch = n - first < BATCH ? n - first : BATCH;
+    for (size_t j = 0; j < batch; ++j) {
+      FilterKey key = make_key(keying, &ulids[first + j]);
+      fps[j] = fingerprint(key);
+      b1[j] = key.index & filter->mask;
+      b2[j] = other_bucket(filter, b1[j], fps[j]);
+      __builtin_prefetch(&filter->buckets[b1[j]]);
+      __builtin_prefetch(&filter->buckets[b2[j]]);
+    }
+    for (size_t j = 0; j < batch; ++j) {
+      int in = cuckoo_contains(filter, b1[j], b2[j], fps[j]);
+      found[first + j] = (uint8_t)in;
+      total += in;
+    }
+  }
+  return total;
+}
+
+int ULID_CuckooFilter_Remove(ULID_CuckooFilter *filter, const ULID *ulid) {
+  ULID_FilterHeader *header = filter->header;
+  FilterKey key = make_key(header->keying, ulid);
+  uint16_t fp = fingerprint(key);
+  uint64_t b1 = key.index & filter->mask;
+  uint64_t b2 = other_bucket(filter, b1, fp);
+  if (header->victim == fp &&
+      (header->victim_bucket == b1 || header->victim_bucket == b2)) {
+    header->victim = 0;
+  } else if (bucket_take(&filter->buckets[b1], fp) ||
+             bucket_take(&filter->buckets[b2], fp)) {
+    if (header->victim) {
+      // there is room now
+      uint16_t victim = (uint16_t)header->victim;
+      header->victim = 0;
+      cuckoo_put(filter, header->victim_bucket, victim);
+    }
+  } else {
+    return 0;
+  }
+  --header->count;
+  return 1;
+}
+
+uint64_t ULID_CuckooFilter_Count(const ULID_CuckooFilter *filter) {
+  return filter->header->count;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+ * Approximate membership filters for ULIDs, see ULID_BloomFilter and
+ * ULID_CuckooFilter.
+ *
+ * A filter is one region of memory: a 64-byte header, then its slots (blocks
+ * of a Bloom filter, buckets of a cuckoo filter), a power of 2 of them.  The
+ * region is saved to a file as is, so a saved filter is used straight from
+ * mmap(), without being read or copied; it is in host byte order, and a file
+ * from a host of the other byte order is rejected by its magic.
+ *
+ * Each ULID gives a key of two words: an index, whose low bits pick a slot
+ * (and, for a cuckoo filter, its first bucket), and a 48-bit tag, which picks
+ * the bits set within a Bloom block, or gives a cuckoo fingerprint.  With
+ * ULID_FILTER_ENTROPY the key is made of entropy bits, with no hashing:
+ *
+ * - the index is the low 64 bits of the entropy; those are the bits that a
+ *   factory increments within a ms, so consecutive ULIDs land in distinct
+ *   slots instead of piling up in one;
+ * - the tag is the next 48 bits up, which only change when a factory draws
+ *   fresh entropy.  A run of ULIDs incremented from one draw shares its tag,
+ *   so their alternate cuckoo buckets are consecutive too; but then false
+ *   positives come in runs: at the usual rate on average, but when a run
+ *   collides with one in the filter, much of it does.
+ *
+ * The time is left out, so that needs entropy that is never drawn twice,
+ * with every bit uniform.  Factories with fixed entropy, with a sub-ms
+ * fraction in it, or with a seed (which draws the same entropy again each
+ * time it is set up) use ULID_FILTER_HASH instead: a hash of the whole ULID.
+ * So do factories using rand(), which gives 31 bits per 4 bytes of entropy:
+ * the top bit of bytes 9 and 13 of their ULIDs is always 0, which would leave
+ * half the slots of a large filter unused.
+ */
+
+#include "ulid.h"
+#include <stdint.h>
+
+// "ULBF" and "ULCF" -- tell the two kinds of filter files apart.
+#define ULID_BLOOM_MAGIC 0x46424c55u
+#define ULID_CUCKOO_MAGIC 0x46434c55u
+
+// Most slots in a filter: the index gives at most 32 bits with
+// ULID_FILTER_ENTROPY, since the tag takes the rest of the entropy.
+#define ULID_FILTER_MAX_LOG2_SLOTS 32
+
+typedef struct ULID_FilterHeader {
+  uint32_t magic;      // ULID_BLOOM_MAGIC or ULID_CUCKOO_MAGIC
+  uint32_t keying;     // an enum ULID_FilterKeying
+  uint32_t log2_slots; // blocks or buckets
+  uint32_t victim;     // cuckoo: a fingerprint left without a bucket, or 0
+  uint64_t victim_bucket;
+  uint64_t count;      // ULIDs added (less removed)
+  uint8_t reserved[32];
+} ULID_FilterHeader; // size: 64 bytes, so slots start on a cache line
@@ -0,0 +1,49 @@
+#include "fork.h"
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Used until detection is set up, and when there is no MADV_WIPEONFORK.
+static volatile uint32_t generation_fallback = 0;
+
+volatile uint32_t *ulid_fork_generation_word = &generation_fallback;
+
+// Only ever grows within a process, so a renewed generation never matches
+// the one that factories inherited from the parent.
+static uint32_t generation_counter = 0;
+
+static pthread_once_t setup_once = PTHREAD_ONCE_INIT;
+
+static void reset_generation_in_child(void) { *ulid_fork_generation_word = 0; }
+
+static void setup_detection(void) {
+#ifdef MADV_WIPEONFORK
+  long size = sysconf(_SC_PAGESIZE);
+  void *page = mmap(0, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (page != MAP_FAILED) {
+    if (madvise(page, size, MADV_WIPEONFORK) == 0) {
+      ulid_fork_generation_word = (volatile uint32_t *)page;
+      return;
+    }
+    munmap(page, size);
+  }
+#endif
+  pthread_atfork(0, 0, reset_generation_in_child);
+}
+
+uint32_t ulid_fork_generation_renew(void) {
+  pthread_once(&setup_once, setup_detection);
+  uint32_t generation = 0;
+  while (generation == 0) {
+    generation = __atomic_add_fetch(&generation_counter, 1, __ATOMIC_RELAXED);
+  }
+  // if another thread got here first, use its generation
+  uint32_t current = 0;
+  if (!__atomic_compare_exchange_n(ulid_fork_generation_word, &current,
+                                   generation, 0, __ATOMIC_RELAXED,
+                                   __ATOMIC_RELAXED)) {
+    generation = current;
+  }
+  return generation;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+/*
+ * Detection of fork(), so that a child process does not keep generating the
+ * same entropy as its parent.
+ *
+ * There is a process-wide generation number which is never zero while it is
+ * valid; it is reset to zero in a child process, either by the kernel (the
+ * word lives in a MADV_WIPEONFORK page, where available) or by a
+ * pthread_atfork() handler.  Factories remember the generation they were
+ * seeded in, and a mismatch means they are now running in a new process.
+ *
+ * Checking the generation costs two loads and a compare -- no syscalls.
+ */
+
+#include <stdint.h>
+
+// The word holding the current generation.
+extern volatile uint32_t *ulid_fork_generation_word;
+
+// Assign a new generation for this process, setting up detection if needed.
+uint32_t ulid_fork_generation_renew(void);
+
+static inline uint32_t ulid_fork_generation(void) {
+  uint32_t generation = *ulid_fork_generation_word;
+  if (__builtin_expect(generation == 0, 0)) {
+    generation = ulid_fork_generation_renew();
+  }
+  return generation;
+}
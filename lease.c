@@ -0,0 +1,344 @@
+#include "lease.h"
+#include "fork.h"
+#include "shared.h"
+#include "ulid.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// Leases start at LEASE_MIN ULIDs, and a client doubles or halves its lease
+// size so that a lease lasts about LEASE_TARGET_NS; a lease still not used up
+// after LEASE_MAX_AGE_NS is dropped, so that leased ULIDs carry a time close
+// enough to when they are handed out.
+#define LEASE_MIN 16u
+#define LEASE_TARGET_NS 1000000ull
+#define LEASE_MAX_AGE_NS 10000000ull
+
+// One past the largest entropy, as a number.
+#define ENTROPY_SPAN ((ulid_u128)1 << (8 * ULID_BYTES_ENTROPY))
+
+struct ULID_LeaseServer {
+  struct pollfd *fds; // fds[0] is the listening socket
+  unsigned count;
+  unsigned capacity;
+  ulid_u128 last; // the last ULID leased
+  ULID_Factory factory;
+  char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+};
+
+struct ULID_LeaseClient {
+  int fd;
+  uint32_t generation; // of the process that connected
+  uint32_t size;       // ULIDs to ask for in the next lease
+  uint32_t remaining;  // ULIDs left in the current lease
+  ulid_u128 next;
+  uint64_t leased_ns;        // when the current lease was granted
+  uint64_t leased_coarse_ns; // same, on the cheaper clock checked per ULID
+  char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+};
+
+static int make_address(struct sockaddr_un *addr, const char *path) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr->sun_path, path);
+  return 0;
+}
+
+static int connect_to(const char *path) {
+  struct sockaddr_un addr;
+  if (make_address(&addr, path) < 0) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  return fd;
+}
+
+static uint64_t monotonic_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Daemon
+ */
+
+ULID_LeaseServer *ULID_LeaseServer_Open(const char *path,
+                                        const ULID_FactoryConfig *config) {
+  struct sockaddr_un addr;
+  if (make_address(&addr, path) < 0) {
+    return 0;
+  }
+  int other = connect_to(path);
+  if (other >= 0) {
+    close(other);
+    errno = EADDRINUSE;
+    return 0;
+  }
+  // Only a socket file nobody listens on (left behind by a dead daemon) is
+  // replaced; anything else at path is not ours to remove.
+  int refused = errno == ECONNREFUSED;
+  struct stat st;
+  if (lstat(path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode) || !refused) {
+      errno = EEXIST;
+      return 0;
+    }
+    unlink(path);
+  } else if (errno != ENOENT) {
+    return 0;
+  }
+
+  ULID_LeaseServer *server =
+      (ULID_LeaseServer *)calloc(1, sizeof(ULID_LeaseServer));
+  if (!server) {
+    return 0;
+  }
+  server->capacity = 16;
+  server->fds = (struct pollfd *)malloc(server->capacity *
+                                        sizeof(struct pollfd));
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (!server->fds || fd < 0 ||
+      bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(fd, SOMAXCONN) < 0) {
+    int saved = errno;
+    if (fd >= 0) {
+      close(fd);
+    }
+    free(server->fds);
+    free(server);
+    errno = saved;
+    return 0;
+  }
+  server->fds[0].fd = fd;
+  server->fds[0].events = POLLIN;
+  server->count = 1;
+  strcpy(server->path, path);
+  ULID_Factory_Init(&server->factory, config);
+  return server;
+}
+
+void ULID_LeaseServer_Close(ULID_LeaseServer *server) {
+  if (server) {
+    for (unsigned j = 0; j < server->count; ++j) {
+      close(server->fds[j].fd);
+    }
+    unlink(server->path);
+    free(server->fds);
+    free(server);
+  }
+}
+
+static uint32_t grant(ULID_LeaseServer *server, uint32_t wanted,
+                      ulid_u128 *first) {
+  ULID candidate;
+  ULID_Create(&server->factory, &candidate);
+  ulid_u128 start = ulid_to_number(&candidate);
+  if (start <= server->last) {
+    start = server->last + 1;
+  }
+  ulid_u128 room = ENTROPY_SPAN - (start & (ENTROPY_SPAN - 1));
+  if (wanted < 1) {
+    wanted = 1;
+  }
+  if (wanted > ULID_LEASE_MAX) {
+    wanted = ULID_LEASE_MAX;
+  }
+  if (wanted > room) {
+    wanted = (uint32_t)room;
+  }
+  server->last = start + wanted - 1;
+  *first = start;
+  return wanted;
+}
+
+static void add_client(ULID_LeaseServer *server, int fd) {
+  if (server->count == server->capacity) {
+    unsigned capacity = server->capacity * 2;
+    struct pollfd *fds = (struct pollfd *)realloc(
+        server->fds, capacity * sizeof(struct pollfd));
+    if (!fds) {
+      close(fd);
+      return;
+    }
+    server->fds = fds;
+    server->capacity = capacity;
+  }
+  server->fds[server->count].fd = fd;
+  server->fds[server->count].events = POLLIN;
+  server->fds[server->count].revents = 0;
+  ++server->count;
+}
+
+// Return 1 if a lease was granted, 0 if not, -1 if the client must be dropped.
+static int serve_client(ULID_LeaseServer *server, int fd) {
+  ULID_LeaseRequest request;
+  ssize_t got = recv(fd, &request, sizeof(request), 0);
+  if (got < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return 0;
+  }
+  if (got != sizeof(request) || request.magic != ULID_LEASE_MAGIC) {
+    return -1;
+  }
+  ULID_LeaseResponse response;
+  memset(&response, 0, sizeof(response));
+  ulid_u128 first;
+  response.count = grant(server, request.count, &first);
+  ulid_from_number((ULID *)response.first, first);
+  if (send(fd, &response, sizeof(response), MSG_NOSIGNAL) !=
+      sizeof(response)) {
+    return -1;
+  }
+  return 1;
+}
+
+int ULID_LeaseServer_Serve(ULID_LeaseServer *server, const int timeout_ms) {
+  int ready = poll(server->fds, server->count, timeout_ms);
+  if (ready <= 0) {
+    return ready < 0 && errno != EINTR ? -1 : 0;
+  }
+  int granted = 0;
+  // backwards, so that dropping a client by moving the last one in its place
+  // does not skip anyone; new clients are only polled next time
+  unsigned count = server->count;
+  for (unsigned j = count; j-- > 1;) {
+    if (!server->fds[j].revents) {
+      continue;
+    }
+    int rc = serve_client(server, server->fds[j].fd);
+    if (rc < 0) {
+      close(server->fds[j].fd);
+      server->fds[j] = server->fds[--server->count];
+    } else {
+      granted += rc;
+    }
+  }
+  if (server->fds[0].revents & POLLIN) {
+    int fd = accept4(server->fds[0].fd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd >= 0) {
+      add_client(server, fd);
+    }
+  }
+  return granted;
+}
+
+/*
+ * Client
+ */
+
+ULID_LeaseClient *ULID_LeaseClient_Open(const char *path) {
+  if (strlen(path) >= sizeof(((ULID_LeaseClient *)0)->path)) {
+    errno = ENAMETOOLONG;
+    return 0;
+  }
+  ULID_LeaseClient *client =
+      (ULID_LeaseClient *)calloc(1, sizeof(ULID_LeaseClient));
+  if (!client) {
+    return 0;
+  }
+  client->fd = connect_to(path);
+  if (client->fd < 0) {
+    int saved = errno;
+    free(client);
+    errno = saved;
+    return 0;
+  }
+  client->generation = ulid_fork_generation();
+  client->size = LEASE_MIN;
+  strcpy(client->path, path);
+  return client;
+}
+
+void ULID_LeaseClient_Close(ULID_LeaseClient *client) {
+  if (client) {
+    close(client->fd);
+    free(client);
+  }
+}
+
+uint32_t ULID_LeaseClient_Lease(ULID_LeaseClient *client,
+                                const uint32_t count, ULID *first) {
+  uint32_t generation = ulid_fork_generation();
+  if (client->generation != generation) {
+    // After fork() parent and child would share the connection, and could
+    // read each other's responses; the child gets its own.
+    int fd = connect_to(client->path);
+    if (fd < 0) {
+      return 0;
+    }
+    close(client->fd);
+    client->fd = fd;
+    client->generation = generation;
+  }
+  ULID_LeaseRequest request = {ULID_LEASE_MAGIC, count};
+  ULID_LeaseResponse response;
+  ssize_t sent = send(client->fd, &request, sizeof(request), MSG_NOSIGNAL);
+  ssize_t got = sent == sizeof(request)
+                    ? recv(client->fd, &response, sizeof(response), 0)
+                    : sent;
+  if (got != sizeof(response)) {
+    if (got >= 0) {
+      // a short message, or none at all: the daemon went away
+      errno = ECONNRESET;
+    }
+    return 0;
+  }
+  memcpy(first->data, response.first, ULID_BYTES_TOTAL);
+  return response.count;
+}
+
+static int renew_lease(ULID_LeaseClient *client, uint64_t coarse_ns) {
+  uint64_t now_ns = monotonic_ns(CLOCK_MONOTONIC);
+  uint64_t age = now_ns - client->leased_ns;
+  if (client->remaining > 0 || age > 2 * LEASE_TARGET_NS) {
+    if (client->size > LEASE_MIN) {
+      client->size /= 2;
+    }
+  } else if (age < LEASE_TARGET_NS / 2 && client->size < ULID_LEASE_MAX) {
+    client->size *= 2;
+  }
+  ULID first;
+  uint32_t count = ULID_LeaseClient_Lease(client, client->size, &first);
+  if (count == 0) {
+    client->remaining = 0;
+    return 0;
+  }
+  client->next = ulid_to_number(&first);
+  client->remaining = count;
+  client->leased_ns = now_ns;
+  client->leased_coarse_ns = coarse_ns;
+  return 1;
+}
+
+int ULID_LeaseClient_Create(ULID_LeaseClient *client, ULID *ulid) {
+  uint64_t coarse_ns = monotonic_ns(CLOCK_MONOTONIC_COARSE);
+  if (client->remaining == 0 ||
+      coarse_ns - client->leased_coarse_ns > LEASE_MAX_AGE_NS ||
+      client->generation != *ulid_fork_generation_word) {
+    if (!renew_lease(client, coarse_ns)) {
+      return 0;
+    }
+  }
+  ulid_from_number(ulid, client->next++);
+  --client->remaining;
+  return 1;
+}
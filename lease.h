@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+ * Protocol of the lease daemon, see ULID_LeaseServer_Open().
+ *
+ * Clients and daemon run on the same host, so messages are fixed-size structs
+ * in host byte order, over a SOCK_SEQPACKET Unix socket, which keeps message
+ * boundaries: one request, one response, no framing.
+ *
+ * A lease is a run of consecutive ULIDs, read as numbers: the first one and a
+ * count.  The daemon never lets a lease carry from the entropy into the time,
+ * so all ULIDs in a lease share the time they were leased at, and it keeps
+ * the last ULID it leased, so each lease starts after all earlier ones.
+ */
+
+#include <stdint.h>
+
+// "ULSE" -- lets the daemon drop anything that is not a lease request.
+#define ULID_LEASE_MAGIC 0x45534c55u
+
+// The daemon never grants more than this in one lease.
+#define ULID_LEASE_MAX 65536u
+
+typedef struct ULID_LeaseRequest {
+  uint32_t magic;
+  uint32_t count; // wanted; the daemon may grant fewer
+} ULID_LeaseRequest;
+
+typedef struct ULID_LeaseResponse {
+  uint8_t first[16]; // a ULID, as created
+  uint32_t count;    // granted, at least 1
+  uint32_t reserved;
+} ULID_LeaseResponse;
@@ -1,4 +1,5 @@
 #include <time.h>
+#include "dispatch.h"
 #include "mtwister.h"
 
 #define MAX_UINT32_I    (4294967295)                // 2^32 - 1 -- as an integer
@@ -100,7 +101,7 @@ void mtwister_build_from_random_seed(MTwister* mt) {
     mtwister_build_from_seed(mt, ts.tv_nsec);
 }
 
-static void twist(MTwister* mt) {
+void mtwister_twist_scalar(MTwister* mt) {
     // This is just a loop in [0, N), but unrolled to avoid arithmetic % N
     for (uint32_t j = 0; j < N - M; ++j) {
         SHAKE(mt->state, j, j + M, j + 1, zero_or_A);
@@ -117,7 +118,7 @@ static void twist(MTwister* mt) {
 // Generates a uint32_t random number on interval [0, 2^32 - 1]
 uint32_t mtwister_generate_u32(MTwister* mt) {
     if (mt->index >= N) {
-        twist(mt);
+        ulid_kernels()->twist(mt);
     }
     uint32_t y = mt->state[mt->index++];
 
@@ -17,6 +17,10 @@ typedef struct MTwister {
     uint16_t index;
 } MTwister;
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Initialize with a given numeric seed.
 void mtwister_build_from_seed(MTwister* mt, const uint32_t seed);
 
@@ -47,4 +51,8 @@ double mtwister_generate_double_01_CO(MTwister* mt);
 // Generates a double random number on open-open interval (0, 1)
 double mtwister_generate_double_01_OO(MTwister* mt);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
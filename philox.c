@@ -0,0 +1,37 @@
+#include "philox.h"
+
+enum {
+  PHILOX_ROUNDS = 10,
+};
+
+#define PHILOX_M0 0xD2511F53U
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U // golden ratio
+#define PHILOX_W1 0xBB67AE85U // sqrt(3) - 1
+
+static inline uint32_t mulhilo(uint32_t a, uint32_t b, uint32_t *hi) {
+  uint64_t product = (uint64_t)a * b;
+  *hi = (uint32_t)(product >> 32);
+  return (uint32_t)product;
+}
+
+void philox4x32(const uint32_t counter[4], const uint32_t key[2],
+                uint32_t out[4]) {
+  uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+  uint32_t k0 = key[0], k1 = key[1];
+  for (unsigned r = 0; r < PHILOX_ROUNDS; ++r) {
+    uint32_t hi0, hi1;
+    uint32_t lo0 = mulhilo(PHILOX_M0, c0, &hi0);
+    uint32_t lo1 = mulhilo(PHILOX_M1, c2, &hi1);
+    c0 = hi1 ^ c1 ^ k0;
+    c1 = lo1;
+    c2 = hi0 ^ c3 ^ k1;
+    c3 = lo0;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
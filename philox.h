@@ -0,0 +1,25 @@
+#pragma once
+
+/*
+ * Philox4x32-10, a counter-based pseudo-random number generator: each output
+ * block is a pure function of a 128-bit counter and a 64-bit key, so any
+ * position of a stream can be computed directly, without generating what
+ * comes before it.
+ *
+ * See Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3" (SC11);
+ * the constants and test vectors are those of the Random123 library.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Generate the 128-bit block for a given counter and key.
+void philox4x32(const uint32_t counter[4], const uint32_t key[2],
+                uint32_t out[4]);
+
+#ifdef __cplusplus
+}
+#endif
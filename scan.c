@@ -0,0 +1,117 @@
+#include "scan.h"
+#include <string.h>
+
+enum {
+  CLASS_ALNUM = 1,
+  CLASS_LEAD = 2,
+};
+
+static unsigned char char_class(const unsigned char c) {
+  unsigned char lower = c | 0x20;
+  if (c >= '0' && c <= '7') {
+    return CLASS_ALNUM | CLASS_LEAD;
+  }
+  if ((c >= '0' && c <= '9') || (lower >= 'a' && lower <= 'z')) {
+    return CLASS_ALNUM;
+  }
+  return 0;
+}
+
+void ulid_classify_scalar(const char *text, const size_t blocks,
+                          uint64_t *alnum, uint64_t *lead) {
+  for (size_t b = 0; b < blocks; ++b, text += ULID_SCAN_BLOCK) {
+    uint64_t a = 0, l = 0;
+    for (unsigned j = 0; j < ULID_SCAN_BLOCK; ++j) {
+      unsigned char cls = char_class((unsigned char)text[j]);
+      a |= (uint64_t)(cls & CLASS_ALNUM) << j;
+      l |= (uint64_t)(cls >> 1) << j;
+    }
+    alnum[b] = a;
+    lead[b] = l;
+  }
+}
+
+// Blocks classified per call to the kernel, plus one to look ahead into.
+enum {
+  CHUNK_BLOCKS = 64,
+};
+
+// Classify the blocks from pos into alnum and lead, up to CHUNK_BLOCKS + 1 of
+// them; chars past the end of the text, and blocks after it, are in no class.
+static void classify_chunk(const ULID_Kernels *kernels, const char *text,
+                           const size_t size, const size_t pos,
+                           uint64_t alnum[CHUNK_BLOCKS + 1],
+                           uint64_t lead[CHUNK_BLOCKS + 1]) {
+  size_t left = size - pos;
+  size_t full = left / ULID_SCAN_BLOCK;
+  if (full > CHUNK_BLOCKS + 1) {
+    full = CHUNK_BLOCKS + 1;
+  }
+  kernels->classify(text + pos, full, alnum, lead);
+  if (full == CHUNK_BLOCKS + 1) {
+    return;
+  }
+  char block[ULID_SCAN_BLOCK] = {0};
+  memcpy(block, text + pos + full * ULID_SCAN_BLOCK,
+         left - full * ULID_SCAN_BLOCK);
+  kernels->classify(block, 1, alnum + full, lead + full);
+  for (size_t b = full + 1; b <= CHUNK_BLOCKS; ++b) {
+    alnum[b] = lead[b] = 0;
+  }
+}
+
+// Return a mask of the positions in alnum starting a run of exactly 26 chars
+// in the alphabet: and-ing the window with itself shifted by 1, 2, 4, 8, then
+// 10 leaves the positions followed by at least 26, and one more shift checks
+// the char after them.  Runs can reach into the next block.
+static inline uint64_t runs_of_26(const uint64_t alnum, const uint64_t next) {
+  unsigned __int128 window = (unsigned __int128)next << 64 | alnum;
+  unsigned __int128 run = window;
+  run &= run >> 1;
+  run &= run >> 2;
+  run &= run >> 4;
+  run &= run >> 8;
+  run &= run >> (ULID_BYTES_FORMATTED - 16);
+  return (uint64_t)run & ~(uint64_t)(window >> ULID_BYTES_FORMATTED);
+}
+
+size_t ULID_Scan(const char *text, const size_t size, size_t *pos,
+                 const uint64_t min_ms, const uint64_t max_ms,
+                 ULID_ScanMatch *matches, const size_t capacity) {
+  const ULID_Kernels *kernels = ulid_kernels();
+  uint64_t alnum[CHUNK_BLOCKS + 1];
+  uint64_t lead[CHUNK_BLOCKS + 1];
+  size_t found = 0;
+  size_t chunk = *pos;
+  uint64_t before =
+      chunk > 0 && chunk <= size &&
+      (char_class((unsigned char)text[chunk - 1]) & CLASS_ALNUM);
+  for (; chunk < size; chunk += CHUNK_BLOCKS * ULID_SCAN_BLOCK) {
+    classify_chunk(kernels, text, size, chunk, alnum, lead);
+    for (unsigned b = 0; b < CHUNK_BLOCKS; ++b) {
+      uint64_t starts = lead[b] & ~((alnum[b] << 1) | before) &
+                        runs_of_26(alnum[b], alnum[b + 1]);
+      before = alnum[b] >> (ULID_SCAN_BLOCK - 1);
+      while (starts) {
+        size_t offset = chunk + b * ULID_SCAN_BLOCK + __builtin_ctzll(starts);
+        starts &= starts - 1;
+        ULID ulid;
+        kernels->parse(&ulid, text + offset);
+        unsigned long time_ms = 0;
+        ULID_GetTime(&ulid, &time_ms);
+        if (time_ms < min_ms || time_ms > max_ms) {
+          continue;
+        }
+        if (found == capacity) {
+          *pos = offset;
+          return found;
+        }
+        matches[found].offset = offset;
+        matches[found].ulid = ulid;
+        ++found;
+      }
+    }
+  }
+  *pos = size;
+  return found;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+/*
+ * Finding ULIDs in text, see ULID_Scan().
+ *
+ * Text is classified 64 chars at a time into two bitmasks (see the classify
+ * kernel in dispatch.h): chars in the alphabet of ULID_Parse(), and chars
+ * that can start a ULID.  A candidate is a lead char not preceded by an
+ * alphabet char; it is a ULID if the next 25 chars are in the alphabet and
+ * the one after is not, which is one shift and compare over the masks of the
+ * block and the next one.  Only ULIDs found this way are decoded and
+ * filtered by time, so most text costs just the classification.
+ */
+
+#include "dispatch.h"
@@ -0,0 +1,211 @@
+#include "shared.h"
+#include "ulid.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// How long to wait for another process to initialize a segment it created.
+#define INIT_WAIT_MS 1000
+
+struct ULID_Shared {
+  ULID_SharedSegment *segment;
+  // Each process draws its own time and entropy for candidate ULIDs, so only
+  // the compare-and-swap touches shared memory.
+  ULID_Factory factory;
+};
+
+static void sleep_ms(long ms) {
+  struct timespec ts = {0, ms * 1000000};
+  nanosleep(&ts, 0);
+}
+
+#if defined(__x86_64__)
+
+static int cas_supported(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("cmpxchg16b");
+}
+
+// Inlined as a lock cmpxchg16b; the __atomic builtins would go through
+// libatomic, which may fall back to a lock private to each process.
+__attribute__((target("cx16"))) static ulid_u128
+cas_last(ULID_SharedSegment *segment, ulid_u128 expected, ulid_u128 desired) {
+  return __sync_val_compare_and_swap(&segment->last, expected, desired);
+}
+
+#else
+
+static int cas_supported(void) { return 0; }
+
+static ulid_u128 cas_last(ULID_SharedSegment *segment, ulid_u128 expected,
+                     ulid_u128 desired) {
+  (void)segment;
+  (void)desired;
+  return expected;
+}
+
+#endif
+
+static void init_segment(ULID_SharedSegment *segment, const unsigned flags) {
+  segment->mode = (flags & ULID_SHARED_LOCK) || !cas_supported()
+                      ? ULID_SHARED_MODE_LOCK
+                      : ULID_SHARED_MODE_CAS;
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&segment->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+  segment->last = 0;
+  __atomic_store_n(&segment->magic, ULID_SHARED_MAGIC, __ATOMIC_RELEASE);
+}
+
+static int wait_for_size(int fd) {
+  for (unsigned waited = 0; waited < INIT_WAIT_MS; ++waited) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+      return -1;
+    }
+    if ((size_t)st.st_size >= sizeof(ULID_SharedSegment)) {
+      return 0;
+    }
+    sleep_ms(1);
+  }
+  errno = ETIMEDOUT;
+  return -1;
+}
+
+static int wait_for_init(ULID_SharedSegment *segment) {
+  for (unsigned waited = 0; waited < INIT_WAIT_MS; ++waited) {
+    if (__atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) ==
+        ULID_SHARED_MAGIC) {
+      return 0;
+    }
+    sleep_ms(1);
+  }
+  errno = ETIMEDOUT;
+  return -1;
+}
+
+static ULID_SharedSegment *map_segment(const char *path,
+                                       const unsigned flags) {
+  int created = 1;
+  int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    created = 0;
+    fd = open(path, O_RDWR | O_CLOEXEC);
+  }
+  if (fd < 0) {
+    return 0;
+  }
+  // A segment is only mapped once it has its full size, since touching a
+  // page past the end of the file raises SIGBUS.
+  int rc = created ? ftruncate(fd, sizeof(ULID_SharedSegment))
+                   : wait_for_size(fd);
+  void *map = MAP_FAILED;
+  if (rc == 0) {
+    map = mmap(0, sizeof(ULID_SharedSegment), PROT_READ | PROT_WRITE,
+               MAP_SHARED, fd, 0);
+  }
+  int saved = errno;
+  close(fd);
+  if (map == MAP_FAILED) {
+    if (created) {
+      unlink(path);
+    }
+    errno = saved;
+    return 0;
+  }
+
+  ULID_SharedSegment *segment = (ULID_SharedSegment *)map;
+  if (created) {
+    init_segment(segment, flags);
+  } else if (wait_for_init(segment) < 0) {
+    munmap(map, sizeof(ULID_SharedSegment));
+    return 0;
+  }
+  return segment;
+}
+
+ULID_Shared *ULID_Shared_Open(const char *path,
+                              const ULID_FactoryConfig *config,
+                              const unsigned flags) {
+  ULID_Shared *shared = (ULID_Shared *)malloc(sizeof(ULID_Shared));
+  if (!shared) {
+    return 0;
+  }
+  shared->segment = map_segment(path, flags);
+  if (!shared->segment) {
+    int saved = errno;
+    free(shared);
+    errno = saved;
+    return 0;
+  }
+  ULID_Factory_Init(&shared->factory, config);
+  return shared;
+}
+
+void ULID_Shared_Close(ULID_Shared *shared) {
+  if (shared) {
+    munmap(shared->segment, sizeof(ULID_SharedSegment));
+    free(shared);
+  }
+}
+
+// Return 0 once the lock is held, or the error that kept it from being taken
+// (such as ENOTRECOVERABLE, when a holder died and the lock was given up).
+static int lock_segment(ULID_SharedSegment *segment) {
+  int error = pthread_mutex_lock(&segment->lock);
+  if (error == EOWNERDEAD) {
+    // The previous holder died, maybe halfway through storing the last ULID.
+    // Each half of a torn store has a time at least as recent as any ULID
+    // issued so far, so the next ms is past all of them.
+    ulid_u128 ms = segment->last >> (8 * ULID_BYTES_ENTROPY);
+    segment->last = (ms + 1) << (8 * ULID_BYTES_ENTROPY);
+    error = pthread_mutex_consistent(&segment->lock);
+    if (error) {
+      pthread_mutex_unlock(&segment->lock);
+    }
+  }
+  return error;
+}
+
+int ULID_Shared_Create(ULID_Shared *shared, ULID *ulid) {
+  ULID candidate;
+  ULID_Create(&shared->factory, &candidate);
+  ulid_u128 next = ulid_to_number(&candidate);
+
+  ULID_SharedSegment *segment = shared->segment;
+  if (segment->mode == ULID_SHARED_MODE_CAS) {
+    // A torn read only means the first compare-and-swap fails, and that
+    // returns the real value.
+    ulid_u128 last = *(volatile ulid_u128 *)&segment->last;
+    for (;;) {
+      ulid_u128 want = next > last ? next : last + 1;
+      ulid_u128 seen = cas_last(segment, last, want);
+      if (seen == last) {
+        next = want;
+        break;
+      }
+      last = seen;
+    }
+  } else {
+    int error = lock_segment(segment);
+    if (error) {
+      errno = error;
+      return 0;
+    }
+    ulid_u128 last = segment->last;
+    if (next <= last) {
+      next = last + 1;
+    }
+    segment->last = next;
+    pthread_mutex_unlock(&segment->lock);
+  }
+  ulid_from_number(ulid, next);
+  return 1;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ * Layout of the shared-memory segment behind a ULID_Shared.
+ *
+ * The segment holds the last ULID issued by any process, as a 128-bit number
+ * (a ULID read as big-endian), so that "next ULID" is just a compare and an
+ * increment.  It is advanced in one of two modes, fixed when the segment is
+ * created, since all processes must agree on it:
+ *
+ * - CAS: a lock-free 128-bit compare-and-swap (cmpxchg16b on x86-64).  A
+ *   process dying at any point leaves the segment consistent.
+ * - LOCK: a robust, process-shared mutex.  If its holder dies, the next
+ *   process to lock it is told so (EOWNERDEAD), and recovers by moving the
+ *   last ULID to the start of the next ms, past anything a torn write could
+ *   have left behind.
+ */
+
+#include "ulid.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+// A ULID read as a big-endian number, which sorts the same way; also used
+// by the lease daemon, see lease.h.
+typedef unsigned __int128 ulid_u128;
+
+static inline ulid_u128 ulid_to_number(const ULID *ulid) {
+  uint64_t hi, lo;
+  memcpy(&hi, ulid->data, sizeof(hi));
+  memcpy(&lo, ulid->data + sizeof(hi), sizeof(lo));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  hi = __builtin_bswap64(hi);
+  lo = __builtin_bswap64(lo);
+#endif
+  return (ulid_u128)hi << 64 | lo;
+}
+
+static inline void ulid_from_number(ULID *ulid, const ulid_u128 n) {
+  uint64_t hi = (uint64_t)(n >> 64), lo = (uint64_t)n;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  hi = __builtin_bswap64(hi);
+  lo = __builtin_bswap64(lo);
+#endif
+  memcpy(ulid->data, &hi, sizeof(hi));
+  memcpy(ulid->data + sizeof(hi), &lo, sizeof(lo));
+}
+
+// "ULID" -- set last, once the creating process has initialized the segment.
+#define ULID_SHARED_MAGIC 0x44494c55u
+
+enum {
+  ULID_SHARED_MODE_CAS = 1,
+  ULID_SHARED_MODE_LOCK = 2,
+};
+
+typedef struct ULID_SharedSegment {
+  uint32_t magic;
+  uint32_t mode;
+  pthread_mutex_t lock; // only used in ULID_SHARED_MODE_LOCK
+  // on its own cache line, which all processes keep bouncing around
+  ulid_u128 last __attribute__((aligned(64)));
+} ULID_SharedSegment;
@@ -0,0 +1,561 @@
+#include "simd.h"
+
+#if ULID_KERNELS_X86
+
+#include <immintrin.h>
+#include <string.h>
+
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512                                                          \
+  __attribute__((target("avx2,avx512f,avx512bw,avx512vl")))
+
+// Only the first ULID_BYTES_FORMATTED bytes (chars) of a vector are valid.
+#define FORMATTED_MASK ((1U << ULID_BYTES_FORMATTED) - 1)
+
+/*
+ * Format
+ *
+ * Each of the 26 5-bit Crockford indices lies within one big-endian 16-bit
+ * word of the ULID: a shuffle gathers the word for each index into its own
+ * 16-bit lane, and a multiply-high by a power of two shifts each lane by its
+ * own amount.  Indices are then translated to characters in parallel, using
+ * two 16-entry shuffle tables.
+ */
+
+static const char Encode[33] = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
+
+// clang-format off
+// For chars [8 * g, 8 * g + 8): bytes with each char's word, little-endian.
+#define WORDS_0  1,  0,  1,  0,  2,  1,  2,  1,  3,  2,  3,  2,  4,  3,  5,  4
+#define WORDS_1  5,  4,  6,  5,  7,  6,  7,  6,  8,  7,  8,  7,  9,  8, 10,  9
+#define WORDS_2 10,  9, 11, 10, 12, 11, 12, 11, 13, 12, 13, 12, 14, 13, 15, 14
+#define WORDS_3 15, 14, -1, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+// For chars [8 * g, 8 * g + 8): multiply-high factor to shift each word.
+#define SHIFTS_0    8, 256, 32, 1024, 128, 4096, 512, 64
+#define SHIFTS_N 2048, 256, 32, 1024, 128, 4096, 512, 64
+#define SHIFTS_3 2048, 256,  1,    1,   1,    1,   1,  1
+// clang-format on
+
+TARGET_SSE42 static inline __m128i indices_sse42(__m128i data, __m128i words,
+                                                 __m128i shifts) {
+  __m128i w = _mm_shuffle_epi8(data, words);
+  return _mm_and_si128(_mm_mulhi_epu16(w, shifts), _mm_set1_epi16(31));
+}
+
+TARGET_SSE42 static inline __m128i encode_sse42(__m128i idx) {
+  const __m128i lo = _mm_loadu_si128((const __m128i *)Encode);
+  const __m128i hi = _mm_loadu_si128((const __m128i *)(Encode + 16));
+  const __m128i upper = _mm_cmpgt_epi8(idx, _mm_set1_epi8(15));
+  return _mm_blendv_epi8(_mm_shuffle_epi8(lo, idx), _mm_shuffle_epi8(hi, idx),
+                         upper);
+}
+
+TARGET_AVX2 static inline __m256i encode_avx2(__m256i idx) {
+  const __m256i lo =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)Encode));
+  const __m256i hi = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)(Encode + 16)));
+  const __m256i upper = _mm256_cmpgt_epi8(idx, _mm256_set1_epi8(15));
+  return _mm256_blendv_epi8(_mm256_shuffle_epi8(lo, idx),
+                            _mm256_shuffle_epi8(hi, idx), upper);
+}
+
+// Return all 26 chars (plus 6 zero indices translated) in one vector.
+TARGET_AVX2 static inline __m256i format_avx2(const ULID *ulid) {
+  const __m256i data = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)ulid->data));
+  __m256i w0 = _mm256_shuffle_epi8(data, _mm256_setr_epi8(WORDS_0, WORDS_1));
+  __m256i w1 = _mm256_shuffle_epi8(data, _mm256_setr_epi8(WORDS_2, WORDS_3));
+  const __m256i mask = _mm256_set1_epi16(31);
+  w0 = _mm256_mulhi_epu16(w0, _mm256_setr_epi16(SHIFTS_0, SHIFTS_N));
+  w1 = _mm256_mulhi_epu16(w1, _mm256_setr_epi16(SHIFTS_N, SHIFTS_3));
+  w0 = _mm256_and_si256(w0, mask);
+  w1 = _mm256_and_si256(w1, mask);
+  // packing works per 128-bit lane, giving chars 0-7, 16-23, 8-15, 24-31
+  __m256i idx = _mm256_packus_epi16(w0, w1);
+  return encode_avx2(_mm256_permute4x64_epi64(idx, 0xd8));
+}
+
+TARGET_SSE42 unsigned ulid_format_sse42(const ULID *ulid,
+                                        char buf[ULID_BYTES_FORMATTED]) {
+  const __m128i data = _mm_loadu_si128((const __m128i *)ulid->data);
+  const __m128i shifts = _mm_setr_epi16(SHIFTS_N);
+  __m128i i0 = indices_sse42(data, _mm_setr_epi8(WORDS_0),
+                             _mm_setr_epi16(SHIFTS_0));
+  __m128i i1 = indices_sse42(data, _mm_setr_epi8(WORDS_1), shifts);
+  __m128i i2 = indices_sse42(data, _mm_setr_epi8(WORDS_2), shifts);
+  __m128i i3 = indices_sse42(data, _mm_setr_epi8(WORDS_3),
+                             _mm_setr_epi16(SHIFTS_3));
+  __m128i head = encode_sse42(_mm_packus_epi16(i0, i1));
+  __m128i tail = encode_sse42(_mm_packus_epi16(i2, i3));
+  // chars [0, 16), then [16, 24) and [24, 26)
+  _mm_storeu_si128((__m128i *)buf, head);
+  _mm_storel_epi64((__m128i *)(buf + 16), tail);
+  uint16_t last = _mm_extract_epi16(tail, 4);
+  memcpy(buf + 24, &last, sizeof(last));
+  return ULID_BYTES_FORMATTED;
+}
+
+TARGET_AVX2 unsigned ulid_format_avx2(const ULID *ulid,
+                                      char buf[ULID_BYTES_FORMATTED]) {
+  __m256i chars = format_avx2(ulid);
+  // chars [0, 16), then [16, 24) and [24, 26)
+  __m128i tail = _mm256_extracti128_si256(chars, 1);
+  _mm_storeu_si128((__m128i *)buf, _mm256_castsi256_si128(chars));
+  _mm_storel_epi64((__m128i *)(buf + 16), tail);
+  uint16_t last = _mm_extract_epi16(tail, 4);
+  memcpy(buf + 24, &last, sizeof(last));
+  return ULID_BYTES_FORMATTED;
+}
+
+TARGET_AVX512 unsigned ulid_format_avx512(const ULID *ulid,
+                                          char buf[ULID_BYTES_FORMATTED]) {
+  _mm256_mask_storeu_epi8(buf, FORMATTED_MASK, format_avx2(ulid));
+  return ULID_BYTES_FORMATTED;
+}
+
+/*
+ * Parse
+ *
+ * Characters are decoded to their 5-bit values in parallel: digits by
+ * subtraction, letters (case-insensitively) by two 16-entry shuffle tables.
+ * Values are then merged pairwise with multiply-adds into eight 20-bit
+ * groups, which are finally shifted into place.
+ *
+ * As with the scalar version, invalid characters give an unspecified result.
+ */
+
+// clang-format off
+#define LETTERS_LO                                                             \
+  /* `     a     b     c     d     e     f     g  */                         \
+  -1,   10,   11,   12,   13,   14,   15,   16,                               \
+  /* h     i     j     k     l     m     n     o  */                         \
+  17,    1,   18,   19,    1,   20,   21,    0
+#define LETTERS_HI                                                             \
+  /* p     q     r     s     t     u     v     w  */                         \
+  22,   23,   24,   25,   26,    0,   27,   28,                               \
+  /* x     y     z                                */                         \
+  29,   30,   31,   -1,   -1,   -1,   -1,   -1
+// clang-format on
+
+TARGET_SSE42 static inline __m128i decode_sse42(__m128i c) {
+  const __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+  const __m128i index = _mm_and_si128(lower, _mm_set1_epi8(0x1f));
+  const __m128i digit = _mm_sub_epi8(index, _mm_set1_epi8(0x10));
+  const __m128i upper = _mm_cmpgt_epi8(index, _mm_set1_epi8(15));
+  const __m128i letter = _mm_blendv_epi8(
+      _mm_shuffle_epi8(_mm_setr_epi8(LETTERS_LO), index),
+      _mm_shuffle_epi8(_mm_setr_epi8(LETTERS_HI), index), upper);
+  const __m128i is_letter = _mm_cmpeq_epi8(
+      _mm_and_si128(lower, _mm_set1_epi8(0x40)), _mm_set1_epi8(0x40));
+  return _mm_blendv_epi8(digit, letter, is_letter);
+}
+
+TARGET_AVX2 static inline __m256i decode_avx2(__m256i c) {
+  const __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+  const __m256i index = _mm256_and_si256(lower, _mm256_set1_epi8(0x1f));
+  const __m256i digit = _mm256_sub_epi8(index, _mm256_set1_epi8(0x10));
+  const __m256i upper = _mm256_cmpgt_epi8(index, _mm256_set1_epi8(15));
+  const __m256i letter = _mm256_blendv_epi8(
+      _mm256_shuffle_epi8(_mm256_setr_epi8(LETTERS_LO, LETTERS_LO), index),
+      _mm256_shuffle_epi8(_mm256_setr_epi8(LETTERS_HI, LETTERS_HI), index),
+      upper);
+  const __m256i is_letter = _mm256_cmpeq_epi8(
+      _mm256_and_si256(lower, _mm256_set1_epi8(0x40)), _mm256_set1_epi8(0x40));
+  return _mm256_blendv_epi8(digit, letter, is_letter);
+}
+
+static inline void store_be64(uint8_t *p, uint64_t v) {
+  v = __builtin_bswap64(v);
+  memcpy(p, &v, sizeof(v));
+}
+
+/*
+ * Groups hold 4 characters each: chars [0, 4) in groups[0], ..., with chars
+ * 24 and 25 at the top of groups[6] and nothing in groups[7].  The 26 chars
+ * carry 130 bits, the top 2 of which are always zero.
+ */
+static inline unsigned parse_groups(ULID *ulid, const uint32_t groups[8]) {
+  const uint64_t g[7] = {
+      groups[0], groups[1], groups[2], groups[3],
+      groups[4], groups[5], groups[6],
+  };
+  const uint64_t hi = (g[0] << 46) | (g[1] << 26) | (g[2] << 6) | (g[3] >> 14);
+  const uint64_t lo = (g[3] << 50) | (g[4] << 30) | (g[5] << 10) | (g[6] >> 10);
+  store_be64(ulid->data, hi);
+  store_be64(ulid->data + 8, lo);
+  return ULID_BYTES_TOTAL;
+}
+
+TARGET_SSE42 static inline __m128i merge_sse42(__m128i values) {
+  // (v0 << 5 | v1) in each 16-bit lane, then (w0 << 10 | w1) in each 32-bit
+  const __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi16(0x0120));
+  return _mm_madd_epi16(pairs, _mm_set1_epi32(0x00010400));
+}
+
+TARGET_AVX2 static inline __m256i merge_avx2(__m256i values) {
+  const __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi16(0x0120));
+  return _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00010400));
+}
+
+TARGET_SSE42 unsigned ulid_parse_sse42(ULID *ulid,
+                                       const char str[ULID_BYTES_FORMATTED]) {
+  // two overlapping loads: chars [0, 16) and [10, 26)
+  __m128i head = decode_sse42(_mm_loadu_si128((const __m128i *)str));
+  __m128i tail = decode_sse42(_mm_loadu_si128((const __m128i *)(str + 10)));
+  tail = _mm_srli_si128(tail, 6); // now chars [16, 26), then zeros
+  uint32_t groups[8];
+  _mm_storeu_si128((__m128i *)groups, merge_sse42(head));
+  _mm_storeu_si128((__m128i *)(groups + 4), merge_sse42(tail));
+  return parse_groups(ulid, groups);
+}
+
+TARGET_AVX2 unsigned ulid_parse_avx2(ULID *ulid,
+                                     const char str[ULID_BYTES_FORMATTED]) {
+  // two overlapping loads: chars [0, 16) and [10, 26)
+  __m256i chars = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)str)),
+      _mm_loadu_si128((const __m128i *)(str + 10)), 1);
+  __m256i values = decode_avx2(chars);
+  // shift only the upper half, so that it holds chars [16, 26), then zeros
+  values =
+      _mm256_blend_epi32(values, _mm256_bsrli_epi128(values, 6), 0xf0);
+  uint32_t groups[8];
+  _mm256_storeu_si256((__m256i *)groups, merge_avx2(values));
+  return parse_groups(ulid, groups);
+}
+
+TARGET_AVX512 unsigned ulid_parse_avx512(ULID *ulid,
+                                         const char str[ULID_BYTES_FORMATTED]) {
+  // a masked load never touches memory past the 26 chars
+  __m256i chars = _mm256_maskz_loadu_epi8(FORMATTED_MASK, str);
+  __m256i values = _mm256_maskz_mov_epi8(FORMATTED_MASK, decode_avx2(chars));
+  uint32_t groups[8];
+  _mm256_storeu_si256((__m256i *)groups, merge_avx2(values));
+  return parse_groups(ulid, groups);
+}
+
+/*
+ * Compare
+ *
+ * Find the first differing byte with a single vector comparison.
+ */
+
+TARGET_SSE42 int ulid_compare_sse42(const ULID *l, const ULID *r) {
+  __m128i lv = _mm_loadu_si128((const __m128i *)l->data);
+  __m128i rv = _mm_loadu_si128((const __m128i *)r->data);
+  unsigned same = _mm_movemask_epi8(_mm_cmpeq_epi8(lv, rv));
+  if (same == 0xffff) {
+    return 0;
+  }
+  unsigned p = __builtin_ctz(~same);
+  return (l->data[p] < r->data[p]) * -2 + 1;
+}
+
+/*
+ * Scan
+ *
+ * Classify a block of 64 chars into two bitmasks: chars in the alphabet
+ * accepted by ULID_Parse() (all ASCII letters and digits), and chars that
+ * can start a ULID ('0' to '7').  Each range check is one subtraction and
+ * one unsigned comparison, done as a signed one by biasing with 0x80.
+ */
+
+#define IN_RANGE_SSE42(c, lo, n)                                               \
+  _mm_cmplt_epi8(_mm_add_epi8(c, _mm_set1_epi8((char)(0x80 - (lo)))),         \
+                 _mm_set1_epi8((char)(0x80 + (n))))
+#define IN_RANGE_AVX2(c, lo, n)                                                \
+  _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 + (n))),                     \
+                    _mm256_add_epi8(c, _mm256_set1_epi8((char)(0x80 - (lo)))))
+
+TARGET_SSE42 void ulid_classify_sse42(const char *text, size_t blocks,
+                                      uint64_t *alnum, uint64_t *lead) {
+  for (size_t b = 0; b < blocks; ++b, text += ULID_SCAN_BLOCK) {
+    uint64_t a = 0, l = 0;
+    for (unsigned j = 0; j < ULID_SCAN_BLOCK; j += 16) {
+      __m128i c = _mm_loadu_si128((const __m128i *)(text + j));
+      __m128i letter = IN_RANGE_SSE42(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+                                      'a', 26);
+      __m128i digit = IN_RANGE_SSE42(c, '0', 10);
+      a |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_or_si128(letter, digit))
+           << j;
+      l |= (uint64_t)(unsigned)_mm_movemask_epi8(IN_RANGE_SSE42(c, '0', 8))
+           << j;
+    }
+    alnum[b] = a;
+    lead[b] = l;
+  }
+}
+
+TARGET_AVX2 void ulid_classify_avx2(const char *text, size_t blocks,
+                                    uint64_t *alnum, uint64_t *lead) {
+  for (size_t b = 0; b < blocks; ++b, text += ULID_SCAN_BLOCK) {
+    uint64_t a = 0, l = 0;
+    for (unsigned j = 0; j < ULID_SCAN_BLOCK; j += 32) {
+      __m256i c = _mm256_loadu_si256((const __m256i *)(text + j));
+      __m256i letter = IN_RANGE_AVX2(
+          _mm256_or_si256(c, _mm256_set1_epi8(0x20)), 'a', 26);
+      __m256i digit = IN_RANGE_AVX2(c, '0', 10);
+      a |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+               _mm256_or_si256(letter, digit))
+           << j;
+      l |= (uint64_t)(uint32_t)_mm256_movemask_epi8(IN_RANGE_AVX2(c, '0', 8))
+           << j;
+    }
+    alnum[b] = a;
+    lead[b] = l;
+  }
+}
+
+TARGET_AVX512 void ulid_classify_avx512(const char *text, size_t blocks,
+                                        uint64_t *alnum, uint64_t *lead) {
+  for (size_t b = 0; b < blocks; ++b, text += ULID_SCAN_BLOCK) {
+    __m512i c = _mm512_loadu_si512(text);
+    __m512i digit = _mm512_sub_epi8(c, _mm512_set1_epi8('0'));
+    __m512i letter = _mm512_sub_epi8(
+        _mm512_or_si512(c, _mm512_set1_epi8(0x20)), _mm512_set1_epi8('a'));
+    lead[b] = _mm512_cmplt_epu8_mask(digit, _mm512_set1_epi8(8));
+    alnum[b] = _mm512_cmplt_epu8_mask(digit, _mm512_set1_epi8(10)) |
+               _mm512_cmplt_epu8_mask(letter, _mm512_set1_epi8(26));
+  }
+}
+
+/*
+ * Times
+ *
+ * A ULID's time is its first 6 bytes, big-endian: one byte shuffle moves
+ * them, reversed, into the low 6 bytes of a 64-bit lane, zeroing the rest.
+ * Shuffles work within 128-bit lanes, so each ULID lands in its own lane,
+ * and pairs of them are merged and put back in order.
+ *
+ * Times are compared as unsigned; without unsigned 64-bit comparisons before
+ * AVX-512, flipping the top bit makes signed comparisons order them the same.
+ */
+
+// clang-format off
+#define TIME_TO_LO  5, 4, 3, 2, 1, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+#define TIME_TO_HI -1, -1, -1, -1, -1, -1, -1, -1, 5, 4, 3, 2, 1, 0, -1, -1
+// clang-format on
+
+TARGET_SSE42 void ulid_get_times_sse42(const ULID *ulids, size_t n,
+                                       uint64_t *times_ms) {
+  const __m128i lo = _mm_setr_epi8(TIME_TO_LO);
+  const __m128i hi = _mm_setr_epi8(TIME_TO_HI);
+  size_t j = 0;
+  for (; j + 2 <= n; j += 2) {
+    __m128i a = _mm_loadu_si128((const __m128i *)ulids[j].data);
+    __m128i b = _mm_loadu_si128((const __m128i *)ulids[j + 1].data);
+    __m128i t = _mm_or_si128(_mm_shuffle_epi8(a, lo), _mm_shuffle_epi8(b, hi));
+    _mm_storeu_si128((__m128i *)(times_ms + j), t);
+  }
+  ulid_get_times_scalar(ulids + j, n - j, times_ms + j);
+}
+
+TARGET_AVX2 void ulid_get_times_avx2(const ULID *ulids, size_t n,
+                                     uint64_t *times_ms) {
+  const __m256i lo = _mm256_setr_epi8(TIME_TO_LO, TIME_TO_LO);
+  const __m256i hi = _mm256_setr_epi8(TIME_TO_HI, TIME_TO_HI);
+  size_t j = 0;
+  for (; j + 4 <= n; j += 4) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)ulids[j].data);
+    __m256i b = _mm256_loadu_si256((const __m256i *)ulids[j + 2].data);
+    // times 0, 2, 1, 3
+    __m256i t = _mm256_or_si256(_mm256_shuffle_epi8(a, lo),
+                                _mm256_shuffle_epi8(b, hi));
+    _mm256_storeu_si256((__m256i *)(times_ms + j),
+                        _mm256_permute4x64_epi64(t, 0xd8));
+  }
+  ulid_get_times_scalar(ulids + j, n - j, times_ms + j);
+}
+
+TARGET_AVX512 void ulid_get_times_avx512(const ULID *ulids, size_t n,
+                                         uint64_t *times_ms) {
+  const __m512i lo = _mm512_broadcast_i32x4(_mm_setr_epi8(TIME_TO_LO));
+  const __m512i hi = _mm512_broadcast_i32x4(_mm_setr_epi8(TIME_TO_HI));
+  const __m512i order = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+  size_t j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m512i a = _mm512_loadu_si512(ulids[j].data);
+    __m512i b = _mm512_loadu_si512(ulids[j + 4].data);
+    // times 0, 4, 1, 5, 2, 6, 3, 7
+    __m512i t = _mm512_or_si512(_mm512_shuffle_epi8(a, lo),
+                                _mm512_shuffle_epi8(b, hi));
+    _mm512_storeu_si512(times_ms + j, _mm512_permutexvar_epi64(order, t));
+  }
+  ulid_get_times_scalar(ulids + j, n - j, times_ms + j);
+}
+
+#define TIME_FLIP 0x8000000000000000ull
+
+// Merge the lanes of the vectors of minimums and maximums, and the times
+// left over after the vector loop.
+static inline void reduce_time_range(const uint64_t *los, const uint64_t *his,
+                                     unsigned lanes, const uint64_t *rest,
+                                     size_t n, uint64_t *min_ms,
+                                     uint64_t *max_ms) {
+  uint64_t lo = los[0], hi = his[0];
+  for (unsigned k = 1; k < lanes; ++k) {
+    lo = los[k] < lo ? los[k] : lo;
+    hi = his[k] > hi ? his[k] : hi;
+  }
+  for (size_t j = 0; j < n; ++j) {
+    lo = rest[j] < lo ? rest[j] : lo;
+    hi = rest[j] > hi ? rest[j] : hi;
+  }
+  *min_ms = lo;
+  *max_ms = hi;
+}
+
+TARGET_SSE42 void ulid_time_range_sse42(const uint64_t *times_ms, size_t n,
+                                        uint64_t *min_ms, uint64_t *max_ms) {
+  const __m128i flip = _mm_set1_epi64x((long long)TIME_FLIP);
+  __m128i lo = _mm_set1_epi64x((long long)(times_ms[0] ^ TIME_FLIP));
+  __m128i hi = lo;
+  size_t j = 0;
+  for (; j + 2 <= n; j += 2) {
+    __m128i t = _mm_xor_si128(
+        _mm_loadu_si128((const __m128i *)(times_ms + j)), flip);
+    lo = _mm_blendv_epi8(lo, t, _mm_cmpgt_epi64(lo, t));
+    hi = _mm_blendv_epi8(hi, t, _mm_cmpgt_epi64(t, hi));
+  }
+  uint64_t los[2], his[2];
+  _mm_storeu_si128((__m128i *)los, _mm_xor_si128(lo, flip));
+  _mm_storeu_si128((__m128i *)his, _mm_xor_si128(hi, flip));
+  reduce_time_range(los, his, 2, times_ms + j, n - j, min_ms, max_ms);
+}
+
+TARGET_AVX2 void ulid_time_range_avx2(const uint64_t *times_ms, size_t n,
+                                      uint64_t *min_ms, uint64_t *max_ms) {
+  const __m256i flip = _mm256_set1_epi64x((long long)TIME_FLIP);
+  __m256i lo = _mm256_set1_epi64x((long long)(times_ms[0] ^ TIME_FLIP));
+  __m256i hi = lo;
+  size_t j = 0;
+  for (; j + 4 <= n; j += 4) {
+    __m256i t = _mm256_xor_si256(
+        _mm256_loadu_si256((const __m256i *)(times_ms + j)), flip);
+    lo = _mm256_blendv_epi8(lo, t, _mm256_cmpgt_epi64(lo, t));
+    hi = _mm256_blendv_epi8(hi, t, _mm256_cmpgt_epi64(t, hi));
+  }
+  uint64_t los[4], his[4];
+  _mm256_storeu_si256((__m256i *)los, _mm256_xor_si256(lo, flip));
+  _mm256_storeu_si256((__m256i *)his, _mm256_xor_si256(hi, flip));
+  reduce_time_range(los, his, 4, times_ms + j, n - j, min_ms, max_ms);
+}
+
+TARGET_AVX512 void ulid_time_range_avx512(const uint64_t *times_ms, size_t n,
+                                          uint64_t *min_ms, uint64_t *max_ms) {
+  __m512i lo = _mm512_set1_epi64((long long)times_ms[0]);
+  __m512i hi = lo;
+  size_t j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m512i t = _mm512_loadu_si512(times_ms + j);
+    lo = _mm512_min_epu64(lo, t);
+    hi = _mm512_max_epu64(hi, t);
+  }
+  uint64_t los[8], his[8];
+  _mm512_storeu_si512(los, lo);
+  _mm512_storeu_si512(his, hi);
+  reduce_time_range(los, his, 8, times_ms + j, n - j, min_ms, max_ms);
+}
+
+/*
+ * Mersenne Twister
+ *
+ * The twist() loop only reads words ahead of the one being updated, or words
+ * at least M - 1 positions behind it that have already been updated, so it
+ * can process 4, 8 or 16 consecutive words at a time.
+ */
+
+enum {
+  MT_N = MTWISTER_STATE,
+  MT_M = 397,
+  MT_A = 0x9908b0df,
+  MT_UPPER = 0x80000000,
+  MT_LOWER = 0x7fffffff,
+};
+
+#define TWIST_STEP(state, tgt, src, nxt)                                       \
+  do {                                                                         \
+    uint32_t y = (state[tgt] & MT_UPPER) | (state[nxt] & MT_LOWER);            \
+    state[tgt] = state[src] ^ (y >> 1) ^ (-(y & 1) & MT_A);                    \
+  } while (0)
+
+// Run the twist() loop, using vector steps of width W where possible.
+#define TWIST_LOOP(mt, W, vector_step)                                         \
+  do {                                                                         \
+    uint32_t *state = (mt)->state;                                             \
+    uint32_t j = 0;                                                            \
+    for (; j + W <= MT_N - MT_M; j += W) {                                     \
+      vector_step(state, j, j + MT_M);                                         \
+    }                                                                          \
+    for (; j < MT_N - MT_M; ++j) {                                             \
+      TWIST_STEP(state, j, j + MT_M, j + 1);                                   \
+    }                                                                          \
+    for (; j + W <= MT_N - 1; j += W) {                                        \
+      vector_step(state, j, j + MT_M - MT_N);                                  \
+    }                                                                          \
+    for (; j < MT_N - 1; ++j) {                                                \
+      TWIST_STEP(state, j, j + MT_M - MT_N, j + 1);                            \
+    }                                                                          \
+    TWIST_STEP(state, MT_N - 1, MT_M - 1, 0);                                  \
+    (mt)->index = 0;                                                           \
+  } while (0)
+
+TARGET_SSE42 static inline void twist_step_sse42(uint32_t *state, uint32_t tgt,
+                                                 uint32_t src) {
+  __m128i cur = _mm_loadu_si128((const __m128i *)(state + tgt));
+  __m128i nxt = _mm_loadu_si128((const __m128i *)(state + tgt + 1));
+  __m128i far = _mm_loadu_si128((const __m128i *)(state + src));
+  __m128i y = _mm_or_si128(_mm_and_si128(cur, _mm_set1_epi32(MT_UPPER)),
+                           _mm_and_si128(nxt, _mm_set1_epi32(MT_LOWER)));
+  __m128i odd = _mm_cmpeq_epi32(_mm_and_si128(y, _mm_set1_epi32(1)),
+                                _mm_set1_epi32(1));
+  __m128i mag = _mm_and_si128(odd, _mm_set1_epi32(MT_A));
+  __m128i out = _mm_xor_si128(_mm_xor_si128(far, _mm_srli_epi32(y, 1)), mag);
+  _mm_storeu_si128((__m128i *)(state + tgt), out);
+}
+
+TARGET_AVX2 static inline void twist_step_avx2(uint32_t *state, uint32_t tgt,
+                                               uint32_t src) {
+  __m256i cur = _mm256_loadu_si256((const __m256i *)(state + tgt));
+  __m256i nxt = _mm256_loadu_si256((const __m256i *)(state + tgt + 1));
+  __m256i far = _mm256_loadu_si256((const __m256i *)(state + src));
+  __m256i y =
+      _mm256_or_si256(_mm256_and_si256(cur, _mm256_set1_epi32(MT_UPPER)),
+                      _mm256_and_si256(nxt, _mm256_set1_epi32(MT_LOWER)));
+  __m256i odd = _mm256_cmpeq_epi32(_mm256_and_si256(y, _mm256_set1_epi32(1)),
+                                   _mm256_set1_epi32(1));
+  __m256i mag = _mm256_and_si256(odd, _mm256_set1_epi32(MT_A));
+  __m256i out =
+      _mm256_xor_si256(_mm256_xor_si256(far, _mm256_srli_epi32(y, 1)), mag);
+  _mm256_storeu_si256((__m256i *)(state + tgt), out);
+}
+
+TARGET_AVX512 static inline void twist_step_avx512(uint32_t *state,
+                                                   uint32_t tgt, uint32_t src) {
+  __m512i cur = _mm512_loadu_si512(state + tgt);
+  __m512i nxt = _mm512_loadu_si512(state + tgt + 1);
+  __m512i far = _mm512_loadu_si512(state + src);
+  // y = (cur & UPPER) | (nxt & LOWER), as a bitwise select
+  __m512i y = _mm512_ternarylogic_epi32(_mm512_set1_epi32(MT_UPPER), cur, nxt,
+                                        0xca);
+  __mmask16 odd = _mm512_test_epi32_mask(y, _mm512_set1_epi32(1));
+  __m512i out = _mm512_xor_si512(far, _mm512_srli_epi32(y, 1));
+  out = _mm512_mask_xor_epi32(out, odd, out, _mm512_set1_epi32(MT_A));
+  _mm512_storeu_si512(state + tgt, out);
+}
+
+TARGET_SSE42 void mtwister_twist_sse42(MTwister *mt) {
+  TWIST_LOOP(mt, 4, twist_step_sse42);
+}
+
+TARGET_AVX2 void mtwister_twist_avx2(MTwister *mt) {
+  TWIST_LOOP(mt, 8, twist_step_avx2);
+}
+
+TARGET_AVX512 void mtwister_twist_avx512(MTwister *mt) {
+  TWIST_LOOP(mt, 16, twist_step_avx512);
+}
+
+#endif
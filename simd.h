@@ -0,0 +1,45 @@
+#pragma once
+
+/*
+ * SIMD variants of the hot kernels, for x86-64 only.
+ * Each function is compiled for its own target, so these must only be called
+ * after checking the CPU supports it -- see dispatch.h.
+ */
+
+#include "dispatch.h"
+
+#if ULID_KERNELS_X86
+
+unsigned ulid_format_sse42(const ULID *ulid, char buf[ULID_BYTES_FORMATTED]);
+unsigned ulid_format_avx2(const ULID *ulid, char buf[ULID_BYTES_FORMATTED]);
+unsigned ulid_format_avx512(const ULID *ulid, char buf[ULID_BYTES_FORMATTED]);
+
+unsigned ulid_parse_sse42(ULID *ulid, const char str[ULID_BYTES_FORMATTED]);
+unsigned ulid_parse_avx2(ULID *ulid, const char str[ULID_BYTES_FORMATTED]);
+unsigned ulid_parse_avx512(ULID *ulid, const char str[ULID_BYTES_FORMATTED]);
+
+int ulid_compare_sse42(const ULID *l, const ULID *r);
+
+void ulid_classify_sse42(const char *text, size_t blocks, uint64_t *alnum,
+                         uint64_t *lead);
+void ulid_classify_avx2(const char *text, size_t blocks, uint64_t *alnum,
+                        uint64_t *lead);
+void ulid_classify_avx512(const char *text, size_t blocks, uint64_t *alnum,
+                          uint64_t *lead);
+
+void ulid_get_times_sse42(const ULID *ulids, size_t n, uint64_t *times_ms);
+void ulid_get_times_avx2(const ULID *ulids, size_t n, uint64_t *times_ms);
+void ulid_get_times_avx512(const ULID *ulids, size_t n, uint64_t *times_ms);
+
+void ulid_time_range_sse42(const uint64_t *times_ms, size_t n,
+                           uint64_t *min_ms, uint64_t *max_ms);
+void ulid_time_range_avx2(const uint64_t *times_ms, size_t n,
+                          uint64_t *min_ms, uint64_t *max_ms);
+void ulid_time_range_avx512(const uint64_t *times_ms, size_t n,
+                            uint64_t *min_ms, uint64_t *max_ms);
+
+void mtwister_twist_sse42(MTwister *mt);
+void mtwister_twist_avx2(MTwister *mt);
+void mtwister_twist_avx512(MTwister *mt);
+
+#endif
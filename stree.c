@@ -0,0 +1,165 @@
+#include "stree.h"
+#include "ulid.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Children per node.
+#define FANOUT (ULID_STREE_KEYS + 1)
+
+// Searches that go down the tree together in ULID_STree_LowerBoundMany().
+#define GROUP 16
+
+struct ULID_STree {
+  ULID_STreeNode *nodes;
+  size_t count;                     // ULIDs
+  unsigned layers;                  // layer 0 is the bottom one
+  size_t offset[ULID_STREE_LAYERS]; // of each layer's first node
+};
+
+static inline uint64_t load_be64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+// The number of keys in a node less than (hi, lo), without branches.
+static inline unsigned count_less(const ULID_STreeNode *node,
+                                  const uint64_t hi, const uint64_t lo) {
+  unsigned less = 0;
+  for (unsigned j = 0; j < ULID_STREE_KEYS; ++j) {
+    less += (node->hi[j] < hi) | ((node->hi[j] == hi) & (node->lo[j] < lo));
+  }
+  return less;
+}
+
+static void set_key(ULID_STreeNode *node, const unsigned j,
+                    const ULID *ulid) {
+  if (ulid) {
+    node->hi[j] = load_be64(ulid->data);
+    node->lo[j] = load_be64(ulid->data + 8);
+  } else {
+    node->hi[j] = UINT64_MAX;
+    node->lo[j] = UINT64_MAX;
+  }
+}
+
+ULID_STree *ULID_STree_New(const ULID *sorted, const size_t count) {
+  ULID_STree *tree = (ULID_STree *)calloc(1, sizeof(ULID_STree));
+  if (!tree) {
+    return 0;
+  }
+  size_t sizes[ULID_STREE_LAYERS];
+  size_t total = 0;
+  size_t size = (count + ULID_STREE_KEYS - 1) / ULID_STREE_KEYS;
+  if (size == 0) {
+    size = 1;
+  }
+  for (;;) {
+    sizes[tree->layers] = size;
+    tree->offset[tree->layers] = total;
+    total += size;
+    ++tree->layers;
+    if (size == 1) {
+      break;
+    }
+    size = (size + FANOUT - 1) / FANOUT;
+  }
+  tree->nodes = (ULID_STreeNode *)aligned_alloc(
+      64, total * sizeof(ULID_STreeNode));
+  if (!tree->nodes) {
+    free(tree);
+    return 0;
+  }
+  tree->count = count;
+
+  ULID_STreeNode *bottom = tree->nodes;
+  for (size_t r = 0; r < sizes[0] * ULID_STREE_KEYS; ++r) {
+    set_key(&bottom[r / ULID_STREE_KEYS], r % ULID_STREE_KEYS,
+            r < count ? &sorted[r] : 0);
+  }
+  for (unsigned h = 1; h < tree->layers; ++h) {
+    ULID_STreeNode *layer = tree->nodes + tree->offset[h];
+    for (size_t k = 0; k < sizes[h]; ++k) {
+      for (unsigned j = 0; j < ULID_STREE_KEYS; ++j) {
+        // the leftmost bottom node under child j + 1
+        size_t first = k * FANOUT + j + 1;
+        for (unsigned down = 1; down < h; ++down) {
+          first *= FANOUT;
+        }
+        size_t r = first * ULID_STREE_KEYS;
+        set_key(&layer[k], j, r < count ? &sorted[r] : 0);
+      }
+    }
+  }
+  return tree;
+}
+
+void ULID_STree_Free(ULID_STree *tree) {
+  if (tree) {
+    free(tree->nodes);
+    free(tree);
+  }
+}
+
+size_t ULID_STree_Count(const ULID_STree *tree) { return tree->count; }
+
+size_t ULID_STree_LowerBound(const ULID_STree *tree, const ULID *ulid) {
+  const uint64_t hi = load_be64(ulid->data);
+  const uint64_t lo = load_be64(ulid->data + 8);
+  size_t k = 0;
+  for (unsigned h = tree->layers; h-- > 1;) {
+    // All children of a node are known before it is read: fetch them while
+    // it is, so the one picked is (mostly) there already.
+    const ULID_STreeNode *children =
+        tree->nodes + tree->offset[h - 1] + k * FANOUT;
+    for (unsigned c = 0; c < FANOUT; ++c) {
+      __builtin_prefetch(&children[c]);
+    }
+    k = k * FANOUT + count_less(&tree->nodes[tree->offset[h] + k], hi, lo);
+  }
+  size_t rank = k * ULID_STREE_KEYS + count_less(&tree->nodes[k], hi, lo);
+  return rank < tree->count ? rank : tree->count;
+}
+
+void ULID_STree_LowerBoundMany(const ULID_STree *tree, const ULID *ulids,
+                               const size_t n, size_t *ranks) {
+  uint64_t hi[GROUP], lo[GROUP];
+  size_t k[GROUP];
+  for (size_t first = 0; first < n; first += GROUP) {
+    size_t group = n - first < GROUP ? n - first : GROUP;
+    for (size_t j = 0; j < group; ++j) {
+      hi[j] = load_be64(ulids[first + j].data);
+      lo[j] = load_be64(ulids[first + j].data + 8);
+      k[j] = 0;
+    }
+    for (unsigned h = tree->layers; h-- > 1;) {
+      const ULID_STreeNode *layer = tree->nodes + tree->offset[h];
+      const ULID_STreeNode *below = tree->nodes + tree->offset[h - 1];
+      for (size_t j = 0; j < group; ++j) {
+        k[j] = k[j] * FANOUT + count_less(&layer[k[j]], hi[j], lo[j]);
+        __builtin_prefetch(&below[k[j]]);
+      }
+    }
+    for (size_t j = 0; j < group; ++j) {
+      size_t rank = k[j] * ULID_STREE_KEYS +
+                    count_less(&tree->nodes[k[j]], hi[j], lo[j]);
+      ranks[first + j] = rank < tree->count ? rank : tree->count;
+    }
+  }
+}
+
+size_t ULID_STree_Find(const ULID_STree *tree, const ULID *ulid) {
+  size_t rank = ULID_STree_LowerBound(tree, ulid);
+  if (rank < tree->count) {
+    const ULID_STreeNode *node = &tree->nodes[rank / ULID_STREE_KEYS];
+    unsigned j = rank % ULID_STREE_KEYS;
+    if (node->hi[j] == load_be64(ulid->data) &&
+        node->lo[j] == load_be64(ulid->data + 8)) {
+      return rank;
+    }
+  }
+  return tree->count;
+}
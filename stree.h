@@ -0,0 +1,39 @@
+#pragma once
+
+/*
+ * A static search tree over sorted ULIDs, see ULID_STree.
+ *
+ * This is an S+ tree: a B+ tree with no pointers, laid out in layers of
+ * 64-byte nodes.  Each node holds ULID_STREE_KEYS keys (ULIDs split into two
+ * host-order 64-bit halves, compared without byte swapping), and children of
+ * node k in one layer are nodes k * (ULID_STREE_KEYS + 1) + i of the layer
+ * below, so a search computes where to go next instead of loading it.
+ *
+ * The bottom layer holds all ULIDs in order, so a search ends on the rank of
+ * its result.  Each key of an upper node is the first ULID under the child
+ * to its right, and keys past the last ULID are all ones: counting the keys
+ * less than a ULID (branchless, all keys of a node at once) gives the child
+ * to go down to, or in the bottom layer the rank within the node.
+ *
+ * A search reads one node (one cache line) per layer, about log5(n) of them,
+ * where a binary search reads about log2(n) lines, nearly all of them misses
+ * once the ULIDs do not fit in the caches.  The 5 children of a node are
+ * next to each other, so they are prefetched while it is read, overlapping
+ * the misses of two layers.  Searches of many ULIDs go down a layer at a
+ * time for a group of them, prefetching the node each one needs next, so
+ * that the group waits on memory once per layer instead of once per ULID per
+ * layer.
+ */
+
+#include "ulid.h"
+#include <stdint.h>
+
+enum {
+  ULID_STREE_KEYS = 4,    // per node
+  ULID_STREE_LAYERS = 32, // at most, enough for any size_t count
+};
+
+typedef struct ULID_STreeNode {
+  uint64_t hi[ULID_STREE_KEYS]; // time, top 16 bits of entropy
+  uint64_t lo[ULID_STREE_KEYS]; // low 64 bits of entropy
+} ULID_STreeNode;               // size: 64 bytes
@@ -1,7 +1,134 @@
 #include <benchmark/benchmark.h>
 
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <csignal>
 #include <cstring>
+#include <ctime>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <string>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include <philox.h>
 #include <ulid.h>
+#include <ulid_fmt.hpp>
+
+/*
+ * Helpers
+ */
+
+enum {
+  POOL = 1024, // inputs cycled through by the single-call benchmarks
+};
+
+static void make_random_ulids(ULID *ulids, unsigned count) {
+  MTwister mt;
+  mtwister_build_from_seed(&mt, 19690720);
+  for (unsigned p = 0; p < count; ++p) {
+    for (unsigned b = 0; b < ULID_BYTES_TOTAL; b += 4) {
+      uint32_t r = mtwister_generate_u32(&mt);
+      memcpy(ulids[p].data + b, &r, sizeof(r));
+    }
+  }
+}
+
+// ULIDs as a factory creates them in a tight loop: they share their time
+// and only differ in the last bytes of entropy.
+static void make_sequential_ulids(ULID *ulids, unsigned count) {
+  ULID_Factory uf;
+  ULID_Factory_Default(&uf);
+  for (unsigned p = 0; p < count; ++p) {
+    ULID_Create(&uf, &ulids[p]);
+  }
+}
+
+/*
+ * Per-call latencies, in ns, kept in a log-linear histogram: 8 sub-buckets
+ * for each power of two, so each bucket is within 12.5% of its true value.
+ * The overhead of reading the clock is measured once and subtracted.
+ */
+class LatencyHistogram {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  LatencyHistogram() : buckets_(64 * SUB, 0), count_(0), max_(0) {
+    overhead_ = ~0ULL;
+    for (unsigned p = 0; p < 1000; ++p) {
+      Clock::time_point t0 = Clock::now();
+      Clock::time_point t1 = Clock::now();
+      overhead_ = std::min(overhead_, elapsed(t0, t1));
+    }
+  }
+
+  void add(Clock::time_point t0, Clock::time_point t1) {
+    uint64_t ns = elapsed(t0, t1);
+    ns = ns > overhead_ ? ns - overhead_ : 0;
+    ++buckets_[bucket(ns)];
+    ++count_;
+    max_ = std::max(max_, ns);
+  }
+
+  // Report p50, p90, p99, p99.9 and max as counters.
+  void report(benchmark::State &state) const {
+    state.counters["p50_ns"] = percentile(0.50);
+    state.counters["p90_ns"] = percentile(0.90);
+    state.counters["p99_ns"] = percentile(0.99);
+    state.counters["p999_ns"] = percentile(0.999);
+    state.counters["max_ns"] = max_;
+  }
+
+private:
+  enum { SUB = 8 };
+
+  static uint64_t elapsed(Clock::time_point t0, Clock::time_point t1) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)
+        .count();
+  }
+
+  static unsigned bucket(uint64_t ns) {
+    if (ns < SUB) {
+      return ns;
+    }
+    unsigned log = 63 - __builtin_clzll(ns); // >= 3
+    unsigned sub = (ns >> (log - 3)) & (SUB - 1);
+    return (log - 2) * SUB + sub;
+  }
+
+  static double lower_bound(unsigned b) {
+    if (b < SUB) {
+      return b;
+    }
+    unsigned log = b / SUB + 2;
+    return (double)((SUB + b % SUB) << (log - 3));
+  }
+
+  double percentile(double p) const {
+    uint64_t want = (uint64_t)(p * count_);
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < buckets_.size(); ++b) {
+      seen += buckets_[b];
+      if (seen > want) {
+        return lower_bound(b);
+      }
+    }
+    return max_;
+  }
+
+  std::vector<uint64_t> buckets_;
+  uint64_t count_;
+  uint64_t max_;
+  uint64_t overhead_;
+};
+
+/*
+ * Creating ULIDs
+ */
 
 static void CreateDefault(benchmark::State &state) {
   ULID_Factory uf;
@@ -15,6 +142,7 @@ BENCHMARK(CreateDefault);
 
 static void CreateRandTOD(benchmark::State &state) {
   ULID_Factory uf;
+  ULID_Factory_Default(&uf);
   ULID_Factory_SetEntropyKind(&uf, ULID_ENTROPY_RAND);
   while (state.KeepRunning()) {
     ULID ulid;
@@ -25,6 +153,7 @@ BENCHMARK(CreateRandTOD);
 
 static void CreateRandSeedTOD(benchmark::State &state) {
   ULID_Factory uf;
+  ULID_Factory_Default(&uf);
   ULID_Factory_SetEntropyKind(&uf, ULID_ENTROPY_RAND);
   ULID_Factory_SetEntropySeed(&uf, 19690720);
   while (state.KeepRunning()) {
@@ -36,6 +165,7 @@ BENCHMARK(CreateRandSeedTOD);
 
 static void CreateMTwisterTOD(benchmark::State &state) {
   ULID_Factory uf;
+  ULID_Factory_Default(&uf);
   ULID_Factory_SetEntropyKind(&uf, ULID_ENTROPY_MERSENNE_TWISTER);
   while (state.KeepRunning()) {
     ULID ulid;
@@ -46,6 +176,7 @@ BENCHMARK(CreateMTwisterTOD);
 
 static void CreateMTwisterSeedTOD(benchmark::State &state) {
   ULID_Factory uf;
+  ULID_Factory_Default(&uf);
   ULID_Factory_SetEntropyKind(&uf, ULID_ENTROPY_MERSENNE_TWISTER);
   ULID_Factory_SetEntropySeed(&uf, 19690720);
   while (state.KeepRunning()) {
@@ -55,36 +186,1155 @@ static void CreateMTwisterSeedTOD(benchmark::State &state) {
 }
 BENCHMARK(CreateMTwisterSeedTOD);
 
-static void Format(benchmark::State &state) {
+// Sub-ms precision reads a finer clock and draws entropy far more often.
+static void CreateSubMillisecond(benchmark::State &state) {
+  ULID_Factory uf;
+  ULID_Factory_Default(&uf);
+  ULID_Factory_SetSubMillisecond(&uf, state.range(0));
+  while (state.KeepRunning()) {
+    ULID ulid;
+    ULID_Create(&uf, &ulid);
+    benchmark::DoNotOptimize(ulid);
+  }
+}
+BENCHMARK(CreateSubMillisecond)->ArgName("enabled")->Arg(0)->Arg(1);
+
+static void CreateBatch(benchmark::State &state) {
+  const unsigned batch = state.range(0);
+  std::vector<ULID> ulids(batch);
+  ULID_Factory uf;
+  ULID_Factory_Default(&uf);
+  while (state.KeepRunning()) {
+    for (unsigned p = 0; p < batch; ++p) {
+      ULID_Create(&uf, &ulids[p]);
+    }
+    benchmark::DoNotOptimize(ulids.data());
+  }
+  state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(CreateBatch)->ArgName("batch")->RangeMultiplier(8)->Range(1, 4096);
+
+// Every thread has its own factory.
+static void CreateThreads(benchmark::State &state) {
+  ULID_Factory uf;
+  ULID_Factory_Default(&uf);
+  while (state.KeepRunning()) {
+    ULID ulid;
+    ULID_Create(&uf, &ulid);
+    benchmark::DoNotOptimize(ulid);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(CreateThreads)->ThreadRange(1, 64)->UseRealTime();
+
+// Backfill ULIDs for a column of timestamps, with several rows per ms in
+// sorted input, or shuffled; compared with the same done one row at a time.
+enum {
+  BACKFILL_ROWS = 1 << 16,
+};
+
+static std::vector<uint64_t> make_backfill_times(unsigned per_ms,
+                                                 bool sorted) {
+  std::vector<uint64_t> times(BACKFILL_ROWS);
+  for (unsigned p = 0; p < BACKFILL_ROWS; ++p) {
+    times[p] = 1733505202556 + p / per_ms;
+  }
+  if (!sorted) {
+    std::shuffle(times.begin(), times.end(), std::mt19937(19690720));
+  }
+  return times;
+}
+
+static void CreateAt(benchmark::State &state) {
+  std::vector<uint64_t> times =
+      make_backfill_times(state.range(0), state.range(1));
+  std::vector<ULID> ulids(BACKFILL_ROWS);
+  ULID_Factory uf;
+  ULID_Factory_Default(&uf);
+  while (state.KeepRunning()) {
+    ULID_CreateAt(&uf, times.data(), ulids.data(), BACKFILL_ROWS);
+    benchmark::DoNotOptimize(ulids.data());
+  }
+  state.SetItemsProcessed(state.iterations() * BACKFILL_ROWS);
+}
+BENCHMARK(CreateAt)
+    ->ArgNames({"per_ms", "sorted"})
+    ->ArgsProduct({{1, 8, 64}, {1, 0}});
+
+static void CreateAtOneByOne(benchmark::State &state) {
+  std::vector<uint64_t> times =
+      make_backfill_times(state.range(0), state.range(1));
+  std::vector<ULID> ulids(BACKFILL_ROWS);
+  ULID_Factory uf;
+  ULID_Factory_Default(&uf);
+  while (state.KeepRunning()) {
+    for (unsigned p = 0; p < BACKFILL_ROWS; ++p) {
+      ULID_Factory_SetTime(&uf, times[p]);
+      ULID_Create(&uf, &ulids[p]);
+    }
+    benchmark::DoNotOptimize(ulids.data());
+  }
+  state.SetItemsProcessed(state.iterations() * BACKFILL_ROWS);
+}
+BENCHMARK(CreateAtOneByOne)
+    ->ArgNames({"per_ms", "sorted"})
+    ->ArgsProduct({{1, 8, 64}, {1, 0}});
+
+// Generate a reproducible corpus with Philox entropy and a virtual clock:
+// each thread seeks to its own slice of the same sequence, so the output is
+// the same for any number of threads and this should scale with cores.
+static void CreateCorpus(benchmark::State &state) {
+  ULID_FactoryConfig config;
+  memset(&config, 0, sizeof(config));
+  config.kind = ULID_ENTROPY_PHILOX;
+  config.seed = 19690720;
+  config.time_ms = 1733505202556;
+  config.ulids_per_ms = state.range(0);
+  ULID_Factory uf;
+  ULID_Factory_Init(&uf, &config);
+  ULID_Factory_Seek(&uf, (uint64_t)state.thread_index() << 40);
+  while (state.KeepRunning()) {
+    ULID ulid;
+    ULID_Create(&uf, &ulid);
+    benchmark::DoNotOptimize(ulid);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(CreateCorpus)
+    ->ArgName("per_ms")
+    ->RangeMultiplier(64)
+    ->Range(1, 4096)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+
+// Many threads sharing ULID creation: one factory behind a mutex, against
+// one generator per CPU.
+static void CreateShared(benchmark::State &state) {
+  static std::mutex mutex;
+  static ULID_Factory *shared = []() {
+    static ULID_Factory uf;
+    ULID_Factory_Default(&uf);
+    return &uf;
+  }();
+  static ULID_PerCpu *percpu = ULID_PerCpu_New(0);
+  const bool per_cpu = state.range(0);
+  while (state.KeepRunning()) {
+    ULID ulid;
+    if (per_cpu) {
+      ULID_PerCpu_Create(percpu, &ulid);
+    } else {
+      std::lock_guard<std::mutex> lock(mutex);
+      ULID_Create(shared, &ulid);
+    }
+    benchmark::DoNotOptimize(ulid);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(per_cpu ? "per_cpu" : "mutex");
+}
+BENCHMARK(CreateShared)
+    ->ArgName("per_cpu")
+    ->Arg(0)
+    ->Arg(1)
+    ->Threads(1)
+    ->Threads(64)
+    ->Threads(256)
+    ->Threads(1024)
+    ->UseRealTime();
+
+// Several processes creating ULIDs at once: each with its own factory (so
+// ULIDs are only sorted per process), against one ULID_Shared, advanced with
+// a 128-bit CAS or with a robust lock.  The other processes are forked for
+// each run, and their ULIDs count into the total rate.
+enum {
+  PROCESSES_MAX = 16,
+};
+
+struct ProcessesControl {
+  volatile int go;
+  volatile int stop;
+  volatile uint64_t created[PROCESSES_MAX];
+};
+
+static void CreateProcesses(benchmark::State &state) {
+  const unsigned mode = state.range(0);
+  const unsigned processes = state.range(1);
+  const std::string path =
+      "/dev/shm/culid_bench_" + std::to_string(getpid());
+  unlink(path.c_str());
+  ULID_Shared *shared = 0;
+  if (mode) {
+    shared = ULID_Shared_Open(path.c_str(), 0,
+                              mode == 2 ? ULID_SHARED_LOCK : 0);
+    if (!shared) {
+      state.SkipWithError("could not open shared memory");
+      return;
+    }
+  }
+  ProcessesControl *control = (ProcessesControl *)mmap(
+      0, sizeof(ProcessesControl), PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  memset((void *)control, 0, sizeof(ProcessesControl));
+  std::vector<pid_t> children;
+  for (unsigned c = 1; c < processes; ++c) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      ULID_Factory uf;
+      ULID_Factory_Default(&uf);
+      while (!control->go) {
+      }
+      uint64_t created = 0;
+      while (!control->stop) {
+        ULID ulid;
+        if (shared) {
+          ULID_Shared_Create(shared, &ulid);
+        } else {
+          ULID_Create(&uf, &ulid);
+        }
+        benchmark::DoNotOptimize(ulid);
+        ++created;
+      }
+      control->created[c] = created;
+      _exit(0);
+    }
+    children.push_back(pid);
+  }
+
+  ULID_Factory uf;
+  ULID_Factory_Default(&uf);
+  control->go = 1;
+  while (state.KeepRunning()) {
+    ULID ulid;
+    if (shared) {
+      ULID_Shared_Create(shared, &ulid);
+    } else {
+      ULID_Create(&uf, &ulid);
+    }
+    benchmark::DoNotOptimize(ulid);
+  }
+  control->stop = 1;
+  uint64_t total = state.iterations();
+  for (pid_t pid : children) {
+    waitpid(pid, 0, 0);
+  }
+  for (unsigned c = 1; c < processes; ++c) {
+    total += control->created[c];
+  }
+  state.SetItemsProcessed(total);
+  state.SetLabel(mode == 0 ? "per_process" : mode == 1 ? "cas" : "lock");
+
+  munmap((void *)control, sizeof(ProcessesControl));
+  ULID_Shared_Close(shared);
+  unlink(path.c_str());
+}
+BENCHMARK(CreateProcesses)
+    ->ArgNames({"shared", "processes"})
+    ->ArgsProduct({{0, 1, 2}, {1, 2, 4, 8}})
+    ->UseRealTime();
+
+// A lease daemon in another process, over a Unix socket: the latency of one
+// round trip for a lease of a given size, and the rate of creating ULIDs with
+// a client whose lease size adapts, against a local factory.
+static pid_t start_lease_daemon(const std::string &path) {
+  unlink(path.c_str());
+  pid_t pid = fork();
+  if (pid == 0) {
+    ULID_LeaseServer *server = ULID_LeaseServer_Open(path.c_str(), 0);
+    while (server && ULID_LeaseServer_Serve(server, -1) >= 0) {
+    }
+    _exit(1);
+  }
+  return pid;
+}
+
+static ULID_LeaseClient *connect_lease_daemon(const std::string &path) {
+  for (unsigned tries = 0; tries < 1000; ++tries) {
+    ULID_LeaseClient *client = ULID_LeaseClient_Open(path.c_str());
+    if (client) {
+      return client;
+    }
+    usleep(1000);
+  }
+  return 0;
+}
+
+static void LeaseRoundTrip(benchmark::State &state) {
+  const uint32_t count = state.range(0);
+  const std::string path = "/tmp/culid_bench_" + std::to_string(getpid());
+  pid_t daemon = start_lease_daemon(path);
+  ULID_LeaseClient *client = connect_lease_daemon(path);
+  if (!client) {
+    state.SkipWithError("could not connect to lease daemon");
+  }
+  uint64_t leased = 0;
+  while (client && state.KeepRunning()) {
+    ULID first;
+    leased += ULID_LeaseClient_Lease(client, count, &first);
+    benchmark::DoNotOptimize(first);
+  }
+  state.SetItemsProcessed(leased);
+  ULID_LeaseClient_Close(client);
+  kill(daemon, SIGKILL);
+  waitpid(daemon, 0, 0);
+  unlink(path.c_str());
+}
+BENCHMARK(LeaseRoundTrip)
+    ->ArgName("count")
+    ->Arg(1)
+    ->Arg(64)
+    ->Arg(4096)
+    ->Arg(65536)
+    ->UseRealTime();
+
+static void LeaseCreate(benchmark::State &state) {
+  const bool leased = state.range(0);
+  const std::string path = "/tmp/culid_bench_" + std::to_string(getpid());
+  pid_t daemon = leased ? start_lease_daemon(path) : 0;
+  ULID_LeaseClient *client = leased ? connect_lease_daemon(path) : 0;
+  if (leased && !client) {
+    state.SkipWithError("could not connect to lease daemon");
+  }
+  ULID_Factory uf;
+  ULID_Factory_Default(&uf);
+  while (state.KeepRunning()) {
+    ULID ulid;
+    if (leased) {
+      ULID_LeaseClient_Create(client, &ulid);
+    } else {
+      ULID_Create(&uf, &ulid);
+    }
+    benchmark::DoNotOptimize(ulid);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(leased ? "leased" : "local");
+  if (leased) {
+    ULID_LeaseClient_Close(client);
+    kill(daemon, SIGKILL);
+    waitpid(daemon, 0, 0);
+    unlink(path.c_str());
+  }
+}
+BENCHMARK(LeaseCreate)->ArgName("leased")->Arg(0)->Arg(1)->UseRealTime();
+
+// Round-robin over many factories, in a shuffled order: with one factory
+// everything stays in cache, with thousands every call misses.
+static void CreateFactories(benchmark::State &state) {
+  const unsigned count = state.range(0);
+  std::vector<ULID_Factory> factories(count);
+  std::vector<unsigned> order(count);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(19690720));
+  for (unsigned p = 0; p < count; ++p) {
+    ULID_Factory_Default(&factories[p]);
+  }
+  unsigned p = 0;
+  while (state.KeepRunning()) {
+    ULID ulid;
+    ULID_Create(&factories[order[p]], &ulid);
+    benchmark::DoNotOptimize(ulid);
+    if (++p == count) {
+      p = 0;
+    }
+  }
+  state.counters["factory_bytes"] = sizeof(ULID_Factory);
+  state.counters["working_set_bytes"] = (double)count * sizeof(ULID_Factory);
+}
+BENCHMARK(CreateFactories)
+    ->ArgName("factories")
+    ->RangeMultiplier(16)
+    ->Range(1, 16384);
+
+// One factory per connection, for many connections: each call finds its
+// factory cold.  Compares ULID_Factory structs in an array with generators,
+// whose hot state is one aligned cache line; with Philox, drawing entropy
+// does not touch any more lines, with Mersenne Twister it does.
+enum {
+  COLD_FACTORIES = 10000,
+};
+
+static void CreateColdFactories(benchmark::State &state) {
+  const bool generators = state.range(0);
+  ULID_FactoryConfig config;
+  memset(&config, 0, sizeof(config));
+  config.kind = (enum ULID_EntropyKind)state.range(1);
+  std::vector<ULID_Factory> factories(generators ? 0 : COLD_FACTORIES);
+  std::vector<ULID_Generator *> handles(generators ? COLD_FACTORIES : 0);
+  for (unsigned p = 0; p < COLD_FACTORIES; ++p) {
+    if (generators) {
+      handles[p] = ULID_Generator_New(&config);
+    } else {
+      ULID_Factory_Init(&factories[p], &config);
+    }
+  }
+  std::vector<unsigned> order(COLD_FACTORIES);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(19690720));
+  unsigned p = 0;
+  while (state.KeepRunning()) {
+    ULID ulid;
+    if (generators) {
+      ULID_Generator_Create(handles[order[p]], &ulid);
+    } else {
+      ULID_Create(&factories[order[p]], &ulid);
+    }
+    benchmark::DoNotOptimize(ulid);
+    if (++p == COLD_FACTORIES) {
+      p = 0;
+    }
+  }
+  for (ULID_Generator *handle : handles) {
+    ULID_Generator_Free(handle);
+  }
+  state.SetLabel(std::string(generators ? "generator" : "factory") + "/" +
+                 (config.kind == ULID_ENTROPY_PHILOX ? "philox"
+                                                     : "mersenne_twister"));
+}
+BENCHMARK(CreateColdFactories)
+    ->ArgNames({"generators", "kind"})
+    ->ArgsProduct({{0, 1},
+                   {ULID_ENTROPY_MERSENNE_TWISTER, ULID_ENTROPY_PHILOX}});
+
+static void CreateLatency(benchmark::State &state) {
+  LatencyHistogram histogram;
   ULID_Factory uf;
   ULID_Factory_Default(&uf);
-  ULID ulid;
-  ULID_Create(&uf, &ulid);
+  while (state.KeepRunning()) {
+    ULID ulid;
+    LatencyHistogram::Clock::time_point t0 = LatencyHistogram::Clock::now();
+    ULID_Create(&uf, &ulid);
+    LatencyHistogram::Clock::time_point t1 = LatencyHistogram::Clock::now();
+    benchmark::DoNotOptimize(ulid);
+    histogram.add(t0, t1);
+  }
+  histogram.report(state);
+}
+BENCHMARK(CreateLatency);
+
+/*
+ * Setting up factories
+ */
+
+enum FactorySetup {
+  FACTORY_SETUP_DEFAULT,
+  FACTORY_SETUP_INIT,
+  FACTORY_SETUP_CLONE,
+  FACTORY_SETUP_EAGER, // what every setup used to cost: seeding the MT
+                       // (only without create, which would seed again)
+  FACTORY_SETUPS,
+};
+
+// Set up a short-lived factory, optionally creating its first ULID too, as
+// code that makes a factory per request or per task would.
+static void FactorySetup(benchmark::State &state) {
+  static const char *Names[FACTORY_SETUPS] = {
+      "Default",
+      "Init",
+      "Clone",
+      "Default+seeding",
+  };
+  unsigned setup = state.range(0);
+  bool create = state.range(1);
+  ULID_FactoryConfig config;
+  memset(&config, 0, sizeof(config));
+  config.seed = 19690720;
+  ULID_Factory parent;
+  ULID_Factory_Init(&parent, &config);
+  ULID_Factory uf;
+  while (state.KeepRunning()) {
+    switch (setup) {
+    case FACTORY_SETUP_DEFAULT:
+      ULID_Factory_Default(&uf);
+      break;
+    case FACTORY_SETUP_INIT:
+      ULID_Factory_Init(&uf, &config);
+      break;
+    case FACTORY_SETUP_CLONE:
+      ULID_Factory_Clone(&uf, &parent);
+      break;
+    case FACTORY_SETUP_EAGER:
+      ULID_Factory_Default(&uf);
+      mtwister_build_from_seed(&uf.mt, 19690720);
+      break;
+    }
+    if (create) {
+      ULID ulid;
+      ULID_Create(&uf, &ulid);
+      benchmark::DoNotOptimize(ulid);
+    }
+    benchmark::DoNotOptimize(uf);
+  }
+  state.SetLabel(Names[setup]);
+}
+BENCHMARK(FactorySetup)
+    ->ArgNames({"setup", "create"})
+    ->ArgsProduct({benchmark::CreateDenseRange(0, FACTORY_SETUP_CLONE, 1),
+                   {0, 1}})
+    ->Args({FACTORY_SETUP_EAGER, 0});
+
+/*
+ * Time and entropy sources
+ */
+
+enum ClockSource {
+  CLOCK_SOURCE_GETTIMEOFDAY,
+  CLOCK_SOURCE_REALTIME,
+  CLOCK_SOURCE_REALTIME_COARSE,
+  CLOCK_SOURCE_MONOTONIC,
+  CLOCK_SOURCE_TIME,
+  CLOCK_SOURCES,
+};
+
+static void ClockSource(benchmark::State &state) {
+  static const char *Names[CLOCK_SOURCES] = {
+      "gettimeofday",
+      "clock_gettime(CLOCK_REALTIME)",
+      "clock_gettime(CLOCK_REALTIME_COARSE)",
+      "clock_gettime(CLOCK_MONOTONIC)",
+      "time",
+  };
+  const unsigned source = state.range(0);
+  state.SetLabel(Names[source]);
+  while (state.KeepRunning()) {
+    struct timeval tv;
+    struct timespec ts;
+    switch (source) {
+    case CLOCK_SOURCE_GETTIMEOFDAY:
+      gettimeofday(&tv, 0);
+      benchmark::DoNotOptimize(tv);
+      break;
+    case CLOCK_SOURCE_REALTIME:
+      clock_gettime(CLOCK_REALTIME, &ts);
+      benchmark::DoNotOptimize(ts);
+      break;
+    case CLOCK_SOURCE_REALTIME_COARSE:
+#ifdef CLOCK_REALTIME_COARSE
+      clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+#else
+      clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+      benchmark::DoNotOptimize(ts);
+      break;
+    case CLOCK_SOURCE_MONOTONIC:
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      benchmark::DoNotOptimize(ts);
+      break;
+    case CLOCK_SOURCE_TIME:
+      benchmark::DoNotOptimize(time(0));
+      break;
+    }
+  }
+}
+BENCHMARK(ClockSource)->DenseRange(0, CLOCK_SOURCES - 1);
+
+// Draw the entropy for one ULID, as the factory does when time moves on.
+static void EntropyKind(benchmark::State &state) {
+  static const char *Names[] = {
+      "mersenne_twister",
+      "rand",
+      "philox",
+  };
+  const enum ULID_EntropyKind kind = (enum ULID_EntropyKind)state.range(0);
+  state.SetLabel(Names[kind]);
+  MTwister mt;
+  mtwister_build_from_seed(&mt, 19690720);
+  srand(19690720);
+  const uint32_t key[2] = {19690720, 0};
+  uint32_t counter[4] = {0, 0, 0, 0};
+  while (state.KeepRunning()) {
+    uint8_t entropy[ULID_BYTES_ENTROPY + 2];
+    if (kind == ULID_ENTROPY_PHILOX) {
+      uint32_t block[4];
+      ++counter[0];
+      philox4x32(counter, key, block);
+      memcpy(entropy, block, sizeof(entropy));
+    } else {
+      for (unsigned pos = 0; pos < ULID_BYTES_ENTROPY; pos += 4) {
+        uint32_t random = kind == ULID_ENTROPY_RAND
+                              ? (uint32_t)rand()
+                              : mtwister_generate_u32(&mt);
+        memcpy(entropy + pos, &random, sizeof(random));
+      }
+    }
+    benchmark::DoNotOptimize(entropy);
+  }
+}
+BENCHMARK(EntropyKind)
+    ->Arg(ULID_ENTROPY_MERSENNE_TWISTER)
+    ->Arg(ULID_ENTROPY_RAND)
+    ->Arg(ULID_ENTROPY_PHILOX);
+
+/*
+ * Formatting, parsing and comparing ULIDs
+ *
+ * Inputs are cycled through a pool, so that the branch predictor cannot
+ * learn them.
+ */
+
+static void Format(benchmark::State &state) {
+  static ULID ulids[POOL];
+  make_random_ulids(ulids, POOL);
+  unsigned p = 0;
   while (state.KeepRunning()) {
     char txt[26];
-    ULID_Format(&ulid, txt);
+    ULID_Format(&ulids[p++ % POOL], txt);
+    benchmark::DoNotOptimize(txt);
   }
 }
 BENCHMARK(Format);
 
 static void Parse(benchmark::State &state) {
-  ULID ulid = {0};
+  static ULID ulids[POOL];
+  static char texts[POOL][26];
+  make_random_ulids(ulids, POOL);
+  for (unsigned p = 0; p < POOL; ++p) {
+    ULID_Format(&ulids[p], texts[p]);
+  }
+  unsigned p = 0;
   while (state.KeepRunning()) {
-    ULID_Parse(&ulid, "0001C7STHC0G2081040G208104");
+    ULID ulid;
+    ULID_Parse(&ulid, texts[p++ % POOL]);
+    benchmark::DoNotOptimize(ulid);
   }
 }
 BENCHMARK(Parse);
 
+// Random ULIDs differ in their first byte; sequential ones in their last.
 static void Compare(benchmark::State &state) {
-  ULID_Factory uf;
-  ULID_Factory_Default(&uf);
-  ULID l, r;
-  ULID_Create(&uf, &l);
-  ULID_Create(&uf, &r);
+  static ULID ulids[POOL];
+  if (state.range(0)) {
+    make_sequential_ulids(ulids, POOL);
+  } else {
+    make_random_ulids(ulids, POOL);
+  }
+  unsigned p = 0;
+  while (state.KeepRunning()) {
+    const ULID *l = &ulids[p++ % POOL];
+    const ULID *r = &ulids[p % POOL];
+    benchmark::DoNotOptimize(ULID_Compare(l, r));
+  }
+}
+BENCHMARK(Compare)->ArgName("sequential")->Arg(0)->Arg(1);
+
+static void FormatLatency(benchmark::State &state) {
+  LatencyHistogram histogram;
+  static ULID ulids[POOL];
+  make_random_ulids(ulids, POOL);
+  unsigned p = 0;
+  while (state.KeepRunning()) {
+    char txt[26];
+    LatencyHistogram::Clock::time_point t0 = LatencyHistogram::Clock::now();
+    ULID_Format(&ulids[p++ % POOL], txt);
+    LatencyHistogram::Clock::time_point t1 = LatencyHistogram::Clock::now();
+    benchmark::DoNotOptimize(txt);
+    histogram.add(t0, t1);
+  }
+  histogram.report(state);
+}
+BENCHMARK(FormatLatency);
+
+static void ParseLatency(benchmark::State &state) {
+  LatencyHistogram histogram;
+  static ULID ulids[POOL];
+  static char texts[POOL][26];
+  make_random_ulids(ulids, POOL);
+  for (unsigned p = 0; p < POOL; ++p) {
+    ULID_Format(&ulids[p], texts[p]);
+  }
+  unsigned p = 0;
+  while (state.KeepRunning()) {
+    ULID ulid;
+    LatencyHistogram::Clock::time_point t0 = LatencyHistogram::Clock::now();
+    ULID_Parse(&ulid, texts[p++ % POOL]);
+    LatencyHistogram::Clock::time_point t1 = LatencyHistogram::Clock::now();
+    benchmark::DoNotOptimize(ulid);
+    histogram.add(t0, t1);
+  }
+  histogram.report(state);
+}
+BENCHMARK(ParseLatency);
+
+/*
+ * Kernels for each CPU level
+ */
+
+// Run a benchmark with the kernels for the CPU level in state.range(0).
+// Return false if the CPU does not support that level.
+static bool use_cpu_level(benchmark::State &state) {
+  const enum ULID_CpuLevel level = (enum ULID_CpuLevel)state.range(0);
+  if (ULID_SetCpuLevel(level) != level) {
+    state.SkipWithError("CPU level not supported");
+    return false;
+  }
+  state.SetLabel(ULID_CpuLevelName(level));
+  return true;
+}
+
+static void FormatLevel(benchmark::State &state) {
+  const enum ULID_CpuLevel saved = ULID_GetCpuLevel();
+  static ULID ulids[POOL];
+  make_random_ulids(ulids, POOL);
+  if (use_cpu_level(state)) {
+    unsigned p = 0;
+    while (state.KeepRunning()) {
+      char txt[26];
+      ULID_Format(&ulids[p++ % POOL], txt);
+      benchmark::DoNotOptimize(txt);
+    }
+  }
+  ULID_SetCpuLevel(saved);
+}
+BENCHMARK(FormatLevel)->DenseRange(ULID_CPU_SCALAR, ULID_CPU_AVX512);
+
+static void ParseLevel(benchmark::State &state) {
+  const enum ULID_CpuLevel saved = ULID_GetCpuLevel();
+  static ULID ulids[POOL];
+  static char texts[POOL][26];
+  make_random_ulids(ulids, POOL);
+  for (unsigned p = 0; p < POOL; ++p) {
+    ULID_Format(&ulids[p], texts[p]);
+  }
+  if (use_cpu_level(state)) {
+    unsigned p = 0;
+    while (state.KeepRunning()) {
+      ULID ulid;
+      ULID_Parse(&ulid, texts[p++ % POOL]);
+      benchmark::DoNotOptimize(ulid);
+    }
+  }
+  ULID_SetCpuLevel(saved);
+}
+BENCHMARK(ParseLevel)->DenseRange(ULID_CPU_SCALAR, ULID_CPU_AVX512);
+
+static void CompareLevel(benchmark::State &state) {
+  const enum ULID_CpuLevel saved = ULID_GetCpuLevel();
+  static ULID ulids[POOL];
+  make_random_ulids(ulids, POOL);
+  if (use_cpu_level(state)) {
+    unsigned p = 0;
+    while (state.KeepRunning()) {
+      const ULID *l = &ulids[p++ % POOL];
+      const ULID *r = &ulids[p % POOL];
+      benchmark::DoNotOptimize(ULID_Compare(l, r));
+    }
+  }
+  ULID_SetCpuLevel(saved);
+}
+BENCHMARK(CompareLevel)->DenseRange(ULID_CPU_SCALAR, ULID_CPU_AVX512);
+
+// A synthetic log of about 16MB, with a ULID in one line out of ten, and
+// lots of digits (which can start a ULID) in the rest.
+static const std::string &make_scan_log() {
+  static std::string log;
+  if (log.empty()) {
+    ULID_Factory uf;
+    ULID_Factory_Default(&uf);
+    ULID_Factory_SetEntropySeed(&uf, 19690720);
+    std::mt19937 rng(19690720);
+    char txt[ULID_BYTES_FORMATTED];
+    while (log.size() < (16u << 20)) {
+      log += "2024-12-06 12:34:56.789 INFO handled in 12ms path=/api/v1 ";
+      if (rng() % 10 == 0) {
+        ULID ulid;
+        ULID_Create(&uf, &ulid);
+        ULID_Format(&ulid, txt);
+        log += "id=";
+        log.append(txt, sizeof(txt));
+      }
+      log += "\n";
+    }
+  }
+  return log;
+}
+
+static void ScanLevel(benchmark::State &state) {
+  const enum ULID_CpuLevel saved = ULID_GetCpuLevel();
+  const std::string &log = make_scan_log();
+  std::vector<ULID_ScanMatch> matches(1024);
+  if (use_cpu_level(state)) {
+    size_t found = 0;
+    while (state.KeepRunning()) {
+      size_t pos = 0;
+      while (pos < log.size()) {
+        found += ULID_Scan(log.data(), log.size(), &pos, 0, UINT64_MAX,
+                           matches.data(), matches.size());
+      }
+    }
+    state.SetBytesProcessed(state.iterations() * log.size());
+    state.SetItemsProcessed(found);
+  }
+  ULID_SetCpuLevel(saved);
+}
+BENCHMARK(ScanLevel)->DenseRange(ULID_CPU_SCALAR, ULID_CPU_AVX512);
+
+// Analytics scans over 4M ULIDs (64MB as ULID[], 32MB of times in a column),
+// reading only their times: min / max and a per-second histogram, straight
+// from the ULIDs, against from a column.  Bytes are those each layout reads.
+enum {
+  COLUMN_ULIDS = 4 << 20,
+  HISTOGRAM_BUCKETS = 4096,
+};
+
+static const std::vector<ULID> &make_column_ulids() {
+  static std::vector<ULID> ulids;
+  if (ulids.empty()) {
+    ULID_Factory uf;
+    ULID_Factory_Default(&uf);
+    ULID_Factory_SetVirtualTime(&uf, 1733505202556, 1000);
+    ulids.resize(COLUMN_ULIDS);
+    for (ULID &ulid : ulids) {
+      ULID_Create(&uf, &ulid);
+    }
+  }
+  return ulids;
+}
+
+static const ULID_Column &make_column() {
+  static ULID_Column column;
+  if (column.count == 0) {
+    const std::vector<ULID> &ulids = make_column_ulids();
+    ULID_Column_Init(&column, ulids.size());
+    ULID_Column_Append(&column, ulids.data(), ulids.size());
+  }
+  return column;
+}
+
+static void TimeRangeULIDs(benchmark::State &state) {
+  const std::vector<ULID> &ulids = make_column_ulids();
+  while (state.KeepRunning()) {
+    unsigned long lo = ULONG_MAX, hi = 0;
+    for (const ULID &ulid : ulids) {
+      unsigned long t = 0;
+      ULID_GetTime(&ulid, &t);
+      lo = std::min(lo, t);
+      hi = std::max(hi, t);
+    }
+    benchmark::DoNotOptimize(lo);
+    benchmark::DoNotOptimize(hi);
+  }
+  state.SetBytesProcessed(state.iterations() * ulids.size() * sizeof(ULID));
+  state.SetItemsProcessed(state.iterations() * ulids.size());
+}
+BENCHMARK(TimeRangeULIDs);
+
+static void TimeRangeColumn(benchmark::State &state) {
+  const enum ULID_CpuLevel saved = ULID_GetCpuLevel();
+  const ULID_Column &column = make_column();
+  if (use_cpu_level(state)) {
+    while (state.KeepRunning()) {
+      uint64_t lo, hi;
+      ULID_TimeRange(column.time_ms, column.count, &lo, &hi);
+      benchmark::DoNotOptimize(lo);
+      benchmark::DoNotOptimize(hi);
+    }
+    state.SetBytesProcessed(state.iterations() * column.count *
+                            sizeof(uint64_t));
+    state.SetItemsProcessed(state.iterations() * column.count);
+  }
+  ULID_SetCpuLevel(saved);
+}
+BENCHMARK(TimeRangeColumn)->DenseRange(ULID_CPU_SCALAR, ULID_CPU_AVX512);
+
+static void GetTimeManyLevel(benchmark::State &state) {
+  const enum ULID_CpuLevel saved = ULID_GetCpuLevel();
+  const std::vector<ULID> &ulids = make_column_ulids();
+  std::vector<uint64_t> times(POOL);
+  if (use_cpu_level(state)) {
+    while (state.KeepRunning()) {
+      for (size_t p = 0; p < ulids.size(); p += POOL) {
+        ULID_GetTimeMany(&ulids[p], POOL, times.data());
+        benchmark::DoNotOptimize(times.data());
+      }
+    }
+    state.SetBytesProcessed(state.iterations() * ulids.size() * sizeof(ULID));
+    state.SetItemsProcessed(state.iterations() * ulids.size());
+  }
+  ULID_SetCpuLevel(saved);
+}
+BENCHMARK(GetTimeManyLevel)->DenseRange(ULID_CPU_SCALAR, ULID_CPU_AVX512);
+
+static void TimeHistogram(benchmark::State &state) {
+  const bool columnar = state.range(0);
+  const std::vector<ULID> &ulids = make_column_ulids();
+  const ULID_Column &column = make_column();
+  const uint64_t start_ms = column.time_ms[0];
+  std::vector<uint64_t> counts(HISTOGRAM_BUCKETS);
+  while (state.KeepRunning()) {
+    std::fill(counts.begin(), counts.end(), 0);
+    if (columnar) {
+      ULID_TimeHistogram(column.time_ms, column.count, start_ms, 1000,
+                         counts.data(), counts.size());
+    } else {
+      for (const ULID &ulid : ulids) {
+        unsigned long t = 0;
+        ULID_GetTime(&ulid, &t);
+        uint64_t bucket = (t - start_ms) / 1000;
+        if (t >= start_ms && bucket < counts.size()) {
+          ++counts[bucket];
+        }
+      }
+    }
+    benchmark::DoNotOptimize(counts.data());
+  }
+  state.SetBytesProcessed(state.iterations() * ulids.size() *
+                          (columnar ? sizeof(uint64_t) : sizeof(ULID)));
+  state.SetItemsProcessed(state.iterations() * ulids.size());
+  state.SetLabel(columnar ? "column" : "ulids");
+}
+BENCHMARK(TimeHistogram)->ArgName("column")->Arg(0)->Arg(1);
+
+/*
+ * Point lookups in sorted ULIDs
+ */
+
+// Sorted arrays from 16K ULIDs (256KB, within L2) to 32M ULIDs (512MB, past
+// any LLC), searched for random ULIDs they hold: std::lower_bound() with
+// ULID_Compare(), against a search tree, one ULID or a batch at a time.
+enum {
+  SORTED_ULIDS_MAX = 1 << 25,
+  SEARCH_QUERIES = 1 << 14,
+};
+
+static const std::vector<ULID> &make_sorted_ulids() {
+  static std::vector<ULID> ulids;
+  if (ulids.empty()) {
+    ULID_Factory uf;
+    ULID_Factory_Default(&uf);
+    ULID_Factory_SetVirtualTime(&uf, 1733505202556, 1000);
+    ulids.resize(SORTED_ULIDS_MAX);
+    for (ULID &ulid : ulids) {
+      ULID_Create(&uf, &ulid);
+    }
+  }
+  return ulids;
+}
+
+static void SortedLookup(benchmark::State &state) {
+  const size_t count = state.range(0);
+  const int how = state.range(1); // 0: std, 1: tree, 2: tree batched
+  const std::vector<ULID> &sorted = make_sorted_ulids();
+  std::vector<ULID> queries(SEARCH_QUERIES);
+  std::mt19937_64 rng(19690720);
+  for (ULID &query : queries) {
+    query = sorted[rng() % count];
+  }
+  ULID_STree *tree = how ? ULID_STree_New(sorted.data(), count) : 0;
+  std::vector<size_t> ranks(SEARCH_QUERIES);
+  while (state.KeepRunning()) {
+    if (how == 2) {
+      ULID_STree_LowerBoundMany(tree, queries.data(), queries.size(),
+                                ranks.data());
+    } else {
+      for (size_t q = 0; q < queries.size(); ++q) {
+        if (how == 1) {
+          ranks[q] = ULID_STree_LowerBound(tree, &queries[q]);
+        } else {
+          ranks[q] = std::lower_bound(sorted.begin(), sorted.begin() + count,
+                                      queries[q],
+                                      [](const ULID &l, const ULID &r) {
+                                        return ULID_Compare(&l, &r) < 0;
+                                      }) -
+                     sorted.begin();
+        }
+      }
+    }
+    benchmark::DoNotOptimize(ranks.data());
+  }
+  ULID_STree_Free(tree);
+  state.SetItemsProcessed(state.iterations() * queries.size());
+  state.SetLabel(how == 0   ? "std::lower_bound"
+                 : how == 1 ? "tree"
+                            : "tree batched");
+}
+BENCHMARK(SortedLookup)
+    ->ArgNames({"ulids", "how"})
+    ->ArgsProduct({{1 << 14, 1 << 17, 1 << 20, 1 << 23, 1 << 25}, {0, 1, 2}});
+
+/*
+ * Membership filters
+ */
+
+// Filters of the 4M ULIDs above (8MB as a Bloom filter, 16MB as a cuckoo
+// filter, well past the caches), looked up by as many ULIDs, every other one
+// added and the rest created later.  Counter fpr is the rate of false
+// positives among the latter.
+static const std::vector<ULID> &make_filter_queries() {
+  static std::vector<ULID> queries;
+  if (queries.empty()) {
+    const std::vector<ULID> &added = make_column_ulids();
+    ULID_Factory uf;
+    ULID_Factory_Default(&uf);
+    ULID_Factory_SetVirtualTime(&uf, 1733505202556 + 100000000, 1000);
+    queries.resize(added.size());
+    for (size_t j = 0; j < queries.size(); ++j) {
+      if (j % 2) {
+        ULID_Create(&uf, &queries[j]);
+      } else {
+        queries[j] = added[j];
+      }
+    }
+  }
+  return queries;
+}
+
+static void FilterLookup(benchmark::State &state) {
+  const bool cuckoo = state.range(0);
+  const enum ULID_FilterKeying keying = (enum ULID_FilterKeying)state.range(1);
+  const bool batched = state.range(2);
+  static ULID_BloomFilter *blooms[2];
+  static ULID_CuckooFilter *cuckoos[2];
+  const std::vector<ULID> &added = make_column_ulids();
+  const std::vector<ULID> &queries = make_filter_queries();
+  if (cuckoo && !cuckoos[keying]) {
+    cuckoos[keying] = ULID_CuckooFilter_New(added.size(), keying);
+    for (const ULID &ulid : added) {
+      ULID_CuckooFilter_Add(cuckoos[keying], &ulid);
+    }
+  }
+  if (!cuckoo && !blooms[keying]) {
+    blooms[keying] = ULID_BloomFilter_New(added.size(), 0, keying);
+    ULID_BloomFilter_AddMany(blooms[keying], added.data(), added.size());
+  }
+  std::vector<uint8_t> found(POOL);
+  size_t positives = 0;
+  while (state.KeepRunning()) {
+    positives = 0;
+    for (size_t p = 0; p < queries.size(); p += POOL) {
+      if (batched && cuckoo) {
+        positives += ULID_CuckooFilter_ContainsMany(
+            cuckoos[keying], &queries[p], POOL, found.data());
+      } else if (batched) {
+        positives += ULID_BloomFilter_ContainsMany(blooms[keying], &queries[p],
+                                                   POOL, found.data());
+      } else {
+        for (size_t j = 0; j < POOL; ++j) {
+          positives +=
+              cuckoo ? ULID_CuckooFilter_Contains(cuckoos[keying],
+                                                  &queries[p + j])
+                     : ULID_BloomFilter_Contains(blooms[keying],
+                                                 &queries[p + j]);
+        }
+      }
+    }
+    benchmark::DoNotOptimize(positives);
+  }
+  const double others = queries.size() / 2;
+  state.counters["fpr"] = (positives - (queries.size() - others)) / others;
+  state.SetItemsProcessed(state.iterations() * queries.size());
+  state.SetLabel(std::string(cuckoo ? "cuckoo" : "bloom") +
+                 (keying == ULID_FILTER_HASH ? " hash" : " entropy") +
+                 (batched ? " batched" : ""));
+}
+BENCHMARK(FilterLookup)
+    ->ArgNames({"cuckoo", "hash", "batched"})
+    ->ArgsProduct({{0, 1}, {0, 1}, {0, 1}});
+
+// Verifying the 4M column ULIDs, as 16-byte ULIDs (64MB) or as text, one per
+// line (108MB), with a number of threads; bytes are those of the input.
+static void Verify(benchmark::State &state) {
+  const std::vector<ULID> &ulids = make_column_ulids();
+  static std::string text;
+  if (text.empty()) {
+    char txt[ULID_BYTES_FORMATTED];
+    for (const ULID &ulid : ulids) {
+      ULID_Format(&ulid, txt);
+      text.append(txt, sizeof(txt));
+      text += "\n";
+    }
+  }
+  const bool is_text = state.range(0);
+  const unsigned threads = state.range(1);
+  ULID_VerifyReport report;
+  while (state.KeepRunning()) {
+    int ok = is_text ? ULID_VerifyText(text.data(), text.size(), 0,
+                                       UINT64_MAX, threads, &report)
+                     : ULID_Verify(ulids.data(), ulids.size(), 0, UINT64_MAX,
+                                   threads, &report);
+    benchmark::DoNotOptimize(ok);
+  }
+  size_t bytes = is_text ? text.size() : ulids.size() * sizeof(ULID);
+  state.SetBytesProcessed(state.iterations() * bytes);
+  state.SetItemsProcessed(state.iterations() * ulids.size());
+}
+BENCHMARK(Verify)
+    ->ArgNames({"text", "threads"})
+    ->ArgsProduct({{0, 1}, {1, 2, 4, 8}})
+    ->UseRealTime();
+
+// Each iteration draws a full Mersenne Twister state, i.e. one twist().
+static void MTwisterLevel(benchmark::State &state) {
+  const enum ULID_CpuLevel saved = ULID_GetCpuLevel();
+  MTwister mt;
+  mtwister_build_from_seed(&mt, 19690720);
+  if (use_cpu_level(state)) {
+    while (state.KeepRunning()) {
+      uint32_t sum = 0;
+      for (unsigned p = 0; p < MTWISTER_STATE; ++p) {
+        sum += mtwister_generate_u32(&mt);
+      }
+      benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * MTWISTER_STATE);
+  }
+  ULID_SetCpuLevel(saved);
+}
+BENCHMARK(MTwisterLevel)->DenseRange(ULID_CPU_SCALAR, ULID_CPU_AVX512);
+
+/*
+ * Formatting into a growing buffer
+ */
+
+// Format FORMAT_COUNT ULIDs, one per line, into a single growing buffer.
+enum {
+  FORMAT_COUNT = 10000000,
+};
+
+static void FormatManyCopy(benchmark::State &state) {
+  static ULID pool[POOL];
+  make_sequential_ulids(pool, POOL);
+  while (state.KeepRunning()) {
+    std::string out;
+    for (unsigned p = 0; p < FORMAT_COUNT; ++p) {
+      char txt[26];
+      ULID_Format(&pool[p % POOL], txt);
+      out.append(txt, sizeof(txt));
+      out.push_back('\n');
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * FORMAT_COUNT);
+}
+BENCHMARK(FormatManyCopy)->Unit(benchmark::kMillisecond);
+
+static void FormatManyToChars(benchmark::State &state) {
+  static ULID pool[POOL];
+  make_sequential_ulids(pool, POOL);
+  while (state.KeepRunning()) {
+    std::string out;
+    for (unsigned p = 0; p < FORMAT_COUNT; ++p) {
+      size_t size = out.size();
+      out.resize(size + ULID_BYTES_FORMATTED + 1);
+      char *end = ULID_ToChars(&out[size], &out[size] + ULID_BYTES_FORMATTED,
+                               &pool[p % POOL], 0,
+                               ULID_FORMAT_UPPERCASE);
+      *end = '\n';
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * FORMAT_COUNT);
+}
+BENCHMARK(FormatManyToChars)->Unit(benchmark::kMillisecond);
+
+static void FormatManyFmt(benchmark::State &state) {
+  static ULID pool[POOL];
+  make_sequential_ulids(pool, POOL);
   while (state.KeepRunning()) {
-    ULID_Compare(&l, &r);
+    fmt::memory_buffer out;
+    for (unsigned p = 0; p < FORMAT_COUNT; ++p) {
+      fmt::format_to(std::back_inserter(out), "{}\n", pool[p % POOL]);
+    }
+    benchmark::DoNotOptimize(out.data());
   }
+  state.SetItemsProcessed(state.iterations() * FORMAT_COUNT);
 }
-BENCHMARK(Compare);
+BENCHMARK(FormatManyFmt)->Unit(benchmark::kMillisecond);
 
 BENCHMARK_MAIN();
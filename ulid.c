@@ -1,17 +1,36 @@
 #include "ulid.h"
+#include "dispatch.h"
+#include "fork.h"
+#include "philox.h"
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
 #include <time.h>
+#include <unistd.h>
 
 enum {
   ULID_FLAG_SEED = 1 << 0,
   ULID_FLAG_ENTROPY = 1 << 1,
   ULID_FLAG_TIME = 1 << 2,
   ULID_FLAG_USE_RAND = 1 << 3,
+  ULID_FLAG_UNSEEDED = 1 << 4,
+  ULID_FLAG_USE_PHILOX = 1 << 5,
+  ULID_FLAG_VIRTUAL_TIME = 1 << 6,
+  ULID_FLAG_TIME_CHANGED = 1 << 7,
+  ULID_FLAG_SUBMS = 1 << 8,
+  ULID_FLAG_KINDS = ULID_FLAG_USE_RAND | ULID_FLAG_USE_PHILOX,
 };
 
+#ifdef ULID_STATS
+#define STATS_ENABLED 1
+#define STATS_INC(f, counter) (++(f)->stats->counter)
+#else
+#define STATS_ENABLED 0
+#define STATS_INC(f, counter) ((void)0)
+#endif
+
 static inline void init_rand(uint32_t seed) {
   if (seed == 0) {
     struct timeval now;
@@ -28,15 +47,136 @@ static inline void generate_time_ms(unsigned long *time_ms) {
   // printf("time_ms %lu\n", time_ms);
 }
 
-static void inline generate_entropy(ULID_Factory *factory,
+enum {
+  ULID_BITS_FRACTION = 12, // sub-ms precision: 1/4096 ms, about 244ns
+};
+
+static inline void generate_time_fraction(unsigned long *time_ms,
+                                          unsigned *fraction) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  unsigned long ns = now.tv_nsec % 1000000;
+  *time_ms = now.tv_sec * 1000 + now.tv_nsec / 1000000;
+  *fraction = (ns << ULID_BITS_FRACTION) / 1000000;
+}
+
+// The sub-ms fraction lives in the top bits of the entropy.
+static inline unsigned get_fraction(const uint8_t *entropy) {
+  return (entropy[0] << 4) | (entropy[1] >> 4);
+}
+
+static inline void put_fraction(uint8_t *entropy, unsigned fraction) {
+  entropy[0] = (uint8_t)(fraction >> 4);
+  entropy[1] = (uint8_t)((entropy[1] & 0x0f) | (fraction << 4));
+}
+
+static inline uint32_t random_seed(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)ts.tv_nsec ^ (uint32_t)ts.tv_sec;
+}
+
+// Derive the seed for the n-th clone of a factory (murmur3 finalizer).
+static inline uint32_t derive_seed(uint32_t seed, uint32_t n) {
+  uint32_t z = seed + n * 0x9e3779b9U;
+  z = (z ^ (z >> 16)) * 0x85ebca6bU;
+  z = (z ^ (z >> 13)) * 0xc2b2ae35U;
+  return z ^ (z >> 16);
+}
+
+// The parts of a factory, wherever they live: a ULID_Factory keeps them all
+// in one struct, a ULID_Generator aligns them to cache lines.
+typedef struct FactoryParts {
+  ULID_FactoryHot *hot;
+  MTwister *mt;
+  ULID_FactoryStats *stats;
+} FactoryParts;
+
+#define FACTORY_PARTS(factory)                                                 \
+  { &(factory)->hot, &(factory)->mt, &(factory)->stats }
+
+struct ULID_Generator {
+  ULID_FactoryHot hot;
+  MTwister mt __attribute__((aligned(64)));
+  ULID_FactoryStats stats;
+};
+
+// A generator for one CPU, with a lock in the same cache line as its state.
+typedef struct PerCpuSlot {
+  ULID_FactoryHot hot;
+  uint32_t busy;
+  MTwister mt __attribute__((aligned(64)));
+  ULID_FactoryStats stats;
+} PerCpuSlot;
+
+struct ULID_PerCpu {
+  unsigned count;
+  PerCpuSlot *slots;
+};
+
+// Seeding the Mersenne Twister writes all of its 2.5KB of state, so it is
+// deferred until the first time a factory actually draws entropy.
+static void seed_entropy(FactoryParts *f) {
+  uint32_t seed = 0;
+  if (f->hot->flags & ULID_FLAG_SEED) {
+    seed = f->hot->seed;
+  } else {
+    seed = random_seed();
+  }
+  if (f->hot->flags & ULID_FLAG_USE_PHILOX) {
+    f->hot->seed = seed; // nothing to build, but keep it for seeking
+  } else if (f->hot->flags & ULID_FLAG_USE_RAND) {
+    init_rand(seed);
+  } else {
+    mtwister_build_from_seed(f->mt, seed);
+  }
+  f->hot->flags &= ~ULID_FLAG_UNSEEDED;
+  STATS_INC(f, reseeds);
+}
+
+// The entropy for the ULID with a given index in the sequence of a seed, in
+// a fixed byte order so that it is the same on every platform.
+static void philox_entropy(uint32_t seed, uint64_t index,
+                           uint8_t entropy[ULID_BYTES_ENTROPY]) {
+  const uint32_t counter[4] = {(uint32_t)index, (uint32_t)(index >> 32), 0, 0};
+  const uint32_t key[2] = {seed, 0};
+  uint32_t block[4];
+  philox4x32(counter, key, block);
+  for (unsigned pos = 0; pos < ULID_BYTES_ENTROPY; ++pos) {
+    entropy[pos] = (uint8_t)(block[pos / 4] >> (24 - 8 * (pos % 4)));
+  }
+}
+
+// Add delta to entropy, as a big-endian number.
+static void add_entropy(uint8_t entropy[ULID_BYTES_ENTROPY], uint64_t delta) {
+  unsigned carry = 0;
+  for (unsigned p = ULID_BYTES_ENTROPY; p-- > 0 && (delta || carry);) {
+    unsigned sum = entropy[p] + (unsigned)(delta & 0xff) + carry;
+    entropy[p] = (uint8_t)sum;
+    carry = sum >> 8;
+    delta >>= 8;
+  }
+}
+
+static inline void generate_entropy(FactoryParts *f,
                                     uint8_t entropy[ULID_BYTES_ENTROPY]) {
+  if (__builtin_expect(f->hot->flags & ULID_FLAG_UNSEEDED, 0)) {
+    seed_entropy(f);
+  }
+  if (f->hot->flags & ULID_FLAG_USE_PHILOX) {
+    philox_entropy(f->hot->seed, f->hot->calls, entropy);
+    return;
+  }
   unsigned size = sizeof(uint32_t);
   for (unsigned pos = 0; pos < ULID_BYTES_ENTROPY;) {
     uint32_t random = 0;
-    if (factory->flags & ULID_FLAG_USE_RAND) {
+    if (f->hot->flags & ULID_FLAG_USE_RAND) {
       random = rand();
     } else {
-      random = mtwister_generate_u32(&factory->mt);
+      if (f->mt->index >= MTWISTER_STATE) {
+        STATS_INC(f, twists);
+      }
+      random = mtwister_generate_u32(f->mt);
       // printf("RAND: %u\n", random);
     }
     unsigned copy = size;
@@ -53,101 +193,513 @@ static void inline generate_entropy(ULID_Factory *factory,
   // printf("\n");
 }
 
+// Called on the first ULID_Create() after a fork(), in the child process.
+static void reseed_after_fork(FactoryParts *f, uint32_t generation) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  uint32_t seed = (uint32_t)ts.tv_nsec ^ ((uint32_t)getpid() * 2654435761U);
+  mtwister_build_from_seed(f->mt, seed);
+  if (f->hot->flags & ULID_FLAG_USE_RAND) {
+    init_rand(seed);
+  }
+  if (f->hot->flags & ULID_FLAG_USE_PHILOX) {
+    // a new stream for this process; the parent's one stays reproducible
+    f->hot->seed = seed;
+  }
+  f->hot->flags &= ~ULID_FLAG_UNSEEDED;
+  if (!(f->hot->flags & ULID_FLAG_ENTROPY)) {
+    generate_entropy(f, f->hot->entropy);
+  }
+  f->hot->generation = generation;
+  STATS_INC(f, reseeds);
+}
+
+// Reset everything but the PRNG state, which is only written when seeding.
+static void reset_factory(FactoryParts *f) {
+  memset(f->hot, 0, sizeof(ULID_FactoryHot));
+  f->hot->flags = ULID_FLAG_UNSEEDED;
+  f->hot->generation = ulid_fork_generation();
+  f->mt->index = MTWISTER_STATE;
+  memset(f->stats, 0, sizeof(ULID_FactoryStats));
+}
+
+static void init_factory(FactoryParts *f, const ULID_FactoryConfig *config) {
+  reset_factory(f);
+  if (!config) {
+    return;
+  }
+  ULID_FactoryHot *hot = f->hot;
+  if (config->kind == ULID_ENTROPY_RAND) {
+    hot->flags |= ULID_FLAG_USE_RAND;
+  } else if (config->kind == ULID_ENTROPY_PHILOX) {
+    hot->flags |= ULID_FLAG_USE_PHILOX;
+  }
+  if (config->seed) {
+    hot->seed = config->seed;
+    hot->flags |= ULID_FLAG_SEED;
+  }
+  if (config->entropy) {
+    memcpy(hot->entropy, config->entropy, ULID_BYTES_ENTROPY);
+    hot->flags |= ULID_FLAG_ENTROPY;
+  }
+  if (config->submillisecond) {
+    hot->flags |= ULID_FLAG_SUBMS;
+  }
+  if (config->time_ms) {
+    hot->time_ms = config->time_ms;
+    hot->flags |= ULID_FLAG_TIME;
+    hot->ulids_per_ms = config->ulids_per_ms;
+    if (config->ulids_per_ms) {
+      hot->flags |= ULID_FLAG_VIRTUAL_TIME;
+    }
+  }
+}
+
 void ULID_Factory_Default(ULID_Factory *factory) {
-  memset(factory, 0, sizeof(ULID_Factory));
-  init_rand(0);
-  mtwister_build_from_random_seed(&factory->mt);
+  FactoryParts f = FACTORY_PARTS(factory);
+  reset_factory(&f);
+}
+
+void ULID_Factory_Init(ULID_Factory *factory,
+                       const ULID_FactoryConfig *config) {
+  FactoryParts f = FACTORY_PARTS(factory);
+  init_factory(&f, config);
+}
+
+void ULID_Factory_Clone(ULID_Factory *clone, ULID_Factory *factory) {
+  const ULID_FactoryHot *hot = &factory->hot;
+  uint32_t base = hot->seed;
+  if (!(hot->flags & ULID_FLAG_SEED)) {
+    base ^= random_seed();
+  }
+  uint32_t seed = derive_seed(base, ++factory->hot.clones);
+  ULID_Factory_Default(clone);
+  clone->hot.flags |= hot->flags & (ULID_FLAG_ENTROPY | ULID_FLAG_TIME |
+                                    ULID_FLAG_VIRTUAL_TIME | ULID_FLAG_SUBMS |
+                                    ULID_FLAG_KINDS);
+  clone->hot.flags |= ULID_FLAG_SEED;
+  clone->hot.seed = seed;
+  if (clone->hot.flags & ULID_FLAG_TIME) {
+    clone->hot.time_ms = hot->time_ms;
+    clone->hot.ulids_per_ms = hot->ulids_per_ms;
+  }
+  if (clone->hot.flags & ULID_FLAG_ENTROPY) {
+    memcpy(clone->hot.entropy, hot->entropy, ULID_BYTES_ENTROPY);
+  }
 }
 
 void ULID_Factory_SetEntropyKind(ULID_Factory *factory,
                                  const enum ULID_EntropyKind kind) {
+  ULID_FactoryHot *hot = &factory->hot;
+  hot->flags &= ~ULID_FLAG_KINDS;
   switch (kind) {
   case ULID_ENTROPY_RAND:
-    factory->flags |= ULID_FLAG_USE_RAND;
+    hot->flags |= ULID_FLAG_USE_RAND;
     break;
   case ULID_ENTROPY_MERSENNE_TWISTER:
-    factory->flags &= ~ULID_FLAG_USE_RAND;
+    break;
+  case ULID_ENTROPY_PHILOX:
+    hot->flags |= ULID_FLAG_USE_PHILOX;
     break;
   }
-  init_rand(factory->seed);
-  mtwister_build_from_seed(&factory->mt, factory->seed);
+  hot->flags |= ULID_FLAG_UNSEEDED;
 }
 
 void ULID_Factory_SetEntropySeed(ULID_Factory *factory, const uint32_t seed) {
-  factory->seed = seed;
-  factory->flags |= ULID_FLAG_SEED;
-  mtwister_build_from_seed(&factory->mt, factory->seed);
-  init_rand(factory->seed);
+  factory->hot.seed = seed;
+  factory->hot.flags |= ULID_FLAG_SEED | ULID_FLAG_UNSEEDED;
 }
 
 void ULID_Factory_SetEntropy(ULID_Factory *factory,
                              const uint8_t entropy[ULID_BYTES_ENTROPY]) {
-  memcpy(factory->entropy, entropy, ULID_BYTES_ENTROPY);
-  factory->flags |= ULID_FLAG_ENTROPY;
+  memcpy(factory->hot.entropy, entropy, ULID_BYTES_ENTROPY);
+  factory->hot.flags |= ULID_FLAG_ENTROPY;
 }
 
 void ULID_Factory_SetTime(ULID_Factory *factory, const unsigned long time_ms) {
-  factory->time_ms = time_ms;
-  factory->flags |= ULID_FLAG_TIME;
+  ULID_FactoryHot *hot = &factory->hot;
+  if (hot->calls && hot->time_ms != time_ms) {
+    // the next ULID needs fresh entropy, not an increment of the last one
+    hot->flags |= ULID_FLAG_TIME_CHANGED;
+  }
+  hot->time_ms = time_ms;
+  hot->flags |= ULID_FLAG_TIME;
+  hot->flags &= ~ULID_FLAG_VIRTUAL_TIME;
 }
 
-void ULID_Create(ULID_Factory *factory, ULID *ulid) {
-  unsigned inc = 1;
-  if (!(factory->flags & ULID_FLAG_TIME)) {
-    unsigned long time_ms = 0;
-    generate_time_ms(&time_ms);
-    if (factory->time_ms != time_ms) {
-      inc = 0;
+void ULID_Factory_SetSubMillisecond(ULID_Factory *factory, const int enabled) {
+  if (enabled) {
+    factory->hot.flags |= ULID_FLAG_SUBMS;
+  } else {
+    factory->hot.flags &= ~ULID_FLAG_SUBMS;
+  }
+}
+
+void ULID_Factory_SetVirtualTime(ULID_Factory *factory,
+                                 const unsigned long time_ms,
+                                 const uint32_t ulids_per_ms) {
+  ULID_Factory_SetTime(factory, time_ms);
+  factory->hot.ulids_per_ms = ulids_per_ms;
+  if (ulids_per_ms) {
+    factory->hot.flags |= ULID_FLAG_VIRTUAL_TIME;
+  }
+}
+
+int ULID_Factory_Seek(ULID_Factory *factory, const uint64_t n) {
+  FactoryParts f = FACTORY_PARTS(factory);
+  ULID_FactoryHot *hot = f.hot;
+  if (!(hot->flags & ULID_FLAG_USE_PHILOX) || !(hot->flags & ULID_FLAG_TIME) ||
+      (hot->flags & ULID_FLAG_ENTROPY)) {
+    return 0;
+  }
+  // the n-th ULID incremented the entropy drawn by the first one in its ms
+  uint64_t first = 0;
+  if (hot->flags & ULID_FLAG_VIRTUAL_TIME) {
+    first = n - n % hot->ulids_per_ms;
+  }
+  hot->calls = first;
+  if (n > first) {
+    generate_entropy(&f, hot->entropy);
+    add_entropy(hot->entropy, n - first - 1);
+  }
+  hot->calls = n;
+  return 1;
+}
+
+// Add one to the entropy; return 1 if it wrapped around.
+static inline unsigned increment_entropy(uint8_t entropy[ULID_BYTES_ENTROPY]) {
+  for (unsigned p = 0; p < ULID_BYTES_ENTROPY; ++p) {
+    unsigned n = ULID_BYTES_ENTROPY - p - 1;
+    if (entropy[n] < 0xff) {
+      ++entropy[n];
+      return 0;
     }
-    factory->time_ms = time_ms;
+    entropy[n] = 0;
   }
-  ulid->data[0] = (unsigned char)(factory->time_ms >> 40);
-  ulid->data[1] = (unsigned char)(factory->time_ms >> 32);
-  ulid->data[2] = (unsigned char)(factory->time_ms >> 24);
-  ulid->data[3] = (unsigned char)(factory->time_ms >> 16);
-  ulid->data[4] = (unsigned char)(factory->time_ms >> 8);
-  ulid->data[5] = (unsigned char)(factory->time_ms >> 0);
+  return 1;
+}
 
+// Move the factory's entropy on for its next ULID: keep incrementing it
+// while the time stays the same (inc), draw fresh entropy otherwise.
+static inline void next_entropy(FactoryParts *f, unsigned inc) {
+  ULID_FactoryHot *hot = f->hot;
   if (!inc) {
-    if (!(factory->flags & ULID_FLAG_ENTROPY)) {
-      uint8_t entropy[ULID_BYTES_ENTROPY];
-      generate_entropy(factory, entropy);
-      memcpy(factory->entropy, entropy, ULID_BYTES_ENTROPY);
+    if (!(hot->flags & ULID_FLAG_ENTROPY)) {
+      generate_entropy(f, hot->entropy);
+      STATS_INC(f, entropy_refills);
     }
   } else {
-    if (!factory->calls) {
-      uint8_t entropy[ULID_BYTES_ENTROPY];
-      generate_entropy(factory, entropy);
-      memcpy(factory->entropy, entropy, ULID_BYTES_ENTROPY);
+    if (!hot->calls && !(hot->flags & ULID_FLAG_ENTROPY)) {
+      generate_entropy(f, hot->entropy);
+      STATS_INC(f, entropy_refills);
     } else {
-      for (unsigned p = 0; p < ULID_BYTES_ENTROPY; ++p) {
-        unsigned n = ULID_BYTES_ENTROPY - p - 1;
-        if (factory->entropy[n] < 0xff) {
-          ++factory->entropy[n];
-          break;
-        } else {
-          factory->entropy[n] = 0;
+      STATS_INC(f, increments);
+      if (increment_entropy(hot->entropy)) {
+        STATS_INC(f, entropy_overflows);
+      }
+    }
+  }
+}
+
+static inline void create(FactoryParts *f, ULID *ulid) {
+  ULID_FactoryHot *hot = f->hot;
+  uint32_t generation = ulid_fork_generation();
+  if (__builtin_expect(generation != hot->generation, 0)) {
+    reseed_after_fork(f, generation);
+  }
+
+  unsigned inc = 1;
+  uint64_t time_ms = hot->time_ms;
+  unsigned fraction = 0;
+  if (!(hot->flags & ULID_FLAG_TIME)) {
+    unsigned long now = 0;
+    // fixed entropy cannot take the fraction, so it is only incremented
+    if ((hot->flags & (ULID_FLAG_SUBMS | ULID_FLAG_ENTROPY)) ==
+        ULID_FLAG_SUBMS) {
+      generate_time_fraction(&now, &fraction);
+      inc = hot->calls && fraction == get_fraction(hot->entropy);
+    } else {
+      generate_time_ms(&now);
+    }
+    if (hot->time_ms != now) {
+      inc = 0;
+#ifdef ULID_STATS
+      if (now < hot->time_ms) {
+        STATS_INC(f, clock_regressions);
+      }
+      hot->per_ms = 0;
+#endif
+    }
+    hot->time_ms = time_ms = now;
+  } else if (hot->flags & ULID_FLAG_VIRTUAL_TIME) {
+    uint64_t ms = hot->calls / hot->ulids_per_ms;
+    inc = hot->calls != ms * hot->ulids_per_ms;
+    time_ms += ms;
+#ifdef ULID_STATS
+    if (!inc) {
+      hot->per_ms = 0;
+    }
+#endif
+  } else if (hot->flags & ULID_FLAG_TIME_CHANGED) {
+    hot->flags &= ~ULID_FLAG_TIME_CHANGED;
+    inc = 0;
+#ifdef ULID_STATS
+    hot->per_ms = 0;
+#endif
+  }
+  ulid->data[0] = (unsigned char)(time_ms >> 40);
+  ulid->data[1] = (unsigned char)(time_ms >> 32);
+  ulid->data[2] = (unsigned char)(time_ms >> 24);
+  ulid->data[3] = (unsigned char)(time_ms >> 16);
+  ulid->data[4] = (unsigned char)(time_ms >> 8);
+  ulid->data[5] = (unsigned char)(time_ms >> 0);
+
+  next_entropy(f, inc);
+  if ((hot->flags & ULID_FLAG_SUBMS) && !inc &&
+      !(hot->flags & (ULID_FLAG_TIME | ULID_FLAG_ENTROPY))) {
+    put_fraction(hot->entropy, fraction);
+  }
+  memcpy(ulid->data + ULID_BYTES_TIME, hot->entropy, ULID_BYTES_ENTROPY);
+  ++hot->calls;
+#ifdef ULID_STATS
+  ++f->stats->creations;
+  if (++hot->per_ms > f->stats->max_per_ms) {
+    f->stats->max_per_ms = hot->per_ms;
+  }
+#endif
+}
+
+void ULID_Create(ULID_Factory *factory, ULID *ulid) {
+  FactoryParts f = FACTORY_PARTS(factory);
+  create(&f, ulid);
+}
+
+static inline uint64_t load_be64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static inline void store_be64(uint8_t *p, uint64_t v) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  memcpy(p, &v, sizeof(v));
+}
+
+static void create_at(FactoryParts *f, const uint64_t *times_ms, ULID *out,
+                      size_t n) {
+  ULID_FactoryHot *hot = f->hot;
+  uint32_t generation = ulid_fork_generation();
+  if (__builtin_expect(generation != hot->generation, 0)) {
+    reseed_after_fork(f, generation);
+  }
+  if (!n) {
+    return;
+  }
+
+  // the time of the factory's last ULID, if it is known
+  uint64_t last = hot->time_ms;
+  if (hot->flags & (ULID_FLAG_VIRTUAL_TIME | ULID_FLAG_TIME_CHANGED)) {
+    last = ~times_ms[0];
+  }
+  for (size_t p = 0; p < n;) {
+    // the first ULID at each time moves the entropy on as ULID_Create() does
+    uint64_t time_ms = times_ms[p];
+    next_entropy(f, time_ms == last || !hot->calls);
+#ifdef ULID_STATS
+    if (time_ms != last) {
+      hot->per_ms = 0;
+    }
+#endif
+    last = time_ms;
+    ULID *ulid = &out[p];
+    store_be64(ulid->data, time_ms << 16);
+    memcpy(ulid->data + ULID_BYTES_TIME, hot->entropy, ULID_BYTES_ENTROPY);
+    ++hot->calls;
+
+    // the rest of a run with the same time (sorted input) just increments,
+    // 64 bits at a time, carrying into the top 16 bits of entropy if needed
+    uint64_t head = load_be64(ulid->data);
+    uint64_t tail = load_be64(ulid->data + 8);
+    size_t run = p + 1;
+    for (; run < n && times_ms[run] == time_ms; ++run) {
+      if (__builtin_expect(!++tail, 0)) {
+        // the time is in the top 48 bits of head, keep it
+        head = (head & ~0xffffULL) | ((head + 1) & 0xffff);
+        if (!(head & 0xffff)) {
+          STATS_INC(f, entropy_overflows);
         }
       }
+      store_be64(out[run].data, head);
+      store_be64(out[run].data + 8, tail);
+    }
+    hot->calls += run - p - 1;
+#ifdef ULID_STATS
+    f->stats->increments += run - p - 1;
+    f->stats->creations += run - p;
+    // saturated: a run of more than 2^32 rows in one ms is counted in full
+    // in max_per_ms, but not carried on to the next call
+    uint64_t per_ms = hot->per_ms + (run - p);
+    if (per_ms > f->stats->max_per_ms) {
+      f->stats->max_per_ms = per_ms;
     }
+    hot->per_ms = per_ms < UINT32_MAX ? (uint32_t)per_ms : UINT32_MAX;
+#endif
+    p = run;
   }
-  memcpy(ulid->data + ULID_BYTES_TIME, factory->entropy, ULID_BYTES_ENTROPY);
-  ++factory->calls;
+
+  // leave the factory as if it had created the last ULID, which for a fixed
+  // time means as if it was set with ULID_Factory_SetTime()
+  memcpy(hot->entropy, out[n - 1].data + ULID_BYTES_TIME, ULID_BYTES_ENTROPY);
+  hot->time_ms = last;
+  hot->flags &= ~(ULID_FLAG_VIRTUAL_TIME | ULID_FLAG_TIME_CHANGED);
 }
 
-unsigned ULID_Format(const ULID *ulid, char buf[ULID_BYTES_FORMATTED]) {
-  /*
-   * We use strictly Crockford's Base32 alphabet when formatting.
-   * Only digits and uppercase letters.
-   * Skip letters I, L, O, U.
-   */
-  static const char Encode[33] = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
+void ULID_CreateAt(ULID_Factory *factory, const uint64_t *times_ms, ULID *out,
+                   size_t n) {
+  FactoryParts f = FACTORY_PARTS(factory);
+  create_at(&f, times_ms, out, n);
+}
+
+int ULID_Factory_GetStats(const ULID_Factory *factory,
+                          ULID_FactoryStats *stats) {
+  memcpy(stats, &factory->stats, sizeof(ULID_FactoryStats));
+  return STATS_ENABLED;
+}
+
+ULID_Generator *ULID_Generator_New(const ULID_FactoryConfig *config) {
+  ULID_Generator *generator =
+      aligned_alloc(_Alignof(ULID_Generator), sizeof(ULID_Generator));
+  if (!generator) {
+    return 0;
+  }
+  FactoryParts f = FACTORY_PARTS(generator);
+  init_factory(&f, config);
+  return generator;
+}
+
+void ULID_Generator_Free(ULID_Generator *generator) { free(generator); }
+
+void ULID_Generator_Create(ULID_Generator *generator, ULID *ulid) {
+  FactoryParts f = FACTORY_PARTS(generator);
+  create(&f, ulid);
+}
+
+void ULID_Generator_CreateAt(ULID_Generator *generator,
+                             const uint64_t *times_ms, ULID *out, size_t n) {
+  FactoryParts f = FACTORY_PARTS(generator);
+  create_at(&f, times_ms, out, n);
+}
+
+int ULID_Generator_GetStats(const ULID_Generator *generator,
+                            ULID_FactoryStats *stats) {
+  memcpy(stats, &generator->stats, sizeof(ULID_FactoryStats));
+  return STATS_ENABLED;
+}
+
+ULID_PerCpu *ULID_PerCpu_New(const ULID_FactoryConfig *config) {
+  long cpus = sysconf(_SC_NPROCESSORS_CONF);
+  if (cpus < 1) {
+    cpus = 1;
+  }
+  ULID_PerCpu *percpu = malloc(sizeof(ULID_PerCpu));
+  if (!percpu) {
+    return 0;
+  }
+  percpu->count = cpus;
+  percpu->slots =
+      aligned_alloc(_Alignof(PerCpuSlot), cpus * sizeof(PerCpuSlot));
+  if (!percpu->slots) {
+    free(percpu);
+    return 0;
+  }
+  // every slot needs its own stream, even with a given seed
+  uint32_t base = random_seed();
+  if (config && config->seed) {
+    base = config->seed;
+  }
+  for (unsigned c = 0; c < percpu->count; ++c) {
+    PerCpuSlot *slot = &percpu->slots[c];
+    FactoryParts f = FACTORY_PARTS(slot);
+    init_factory(&f, config);
+    // fixed entropy would make every slot create the same ULIDs in a ms
+    slot->hot.flags &= ~ULID_FLAG_ENTROPY;
+    slot->hot.seed = derive_seed(base, c + 1);
+    slot->hot.flags |= ULID_FLAG_SEED;
+    slot->busy = 0;
+  }
+  return percpu;
+}
+
+void ULID_PerCpu_Free(ULID_PerCpu *percpu) {
+  if (percpu) {
+    free(percpu->slots);
+    free(percpu);
+  }
+}
+
+void ULID_PerCpu_Create(ULID_PerCpu *percpu, ULID *ulid) {
+  int cpu = sched_getcpu();
+  unsigned c = cpu < 0 ? 0 : (unsigned)cpu % percpu->count;
+  for (unsigned tries = 1;; ++tries) {
+    PerCpuSlot *slot = &percpu->slots[c];
+    if (!__atomic_load_n(&slot->busy, __ATOMIC_RELAXED) &&
+        !__atomic_exchange_n(&slot->busy, 1, __ATOMIC_ACQUIRE)) {
+      FactoryParts f = FACTORY_PARTS(slot);
+      create(&f, ulid);
+      __atomic_store_n(&slot->busy, 0, __ATOMIC_RELEASE);
+      return;
+    }
+    if (++c == percpu->count) {
+      c = 0;
+    }
+    if (tries % percpu->count == 0) {
+      sched_yield(); // all busy: let their holders run
+    }
+  }
+}
+
+int ULID_PerCpu_GetStats(const ULID_PerCpu *percpu, ULID_FactoryStats *stats) {
+  memset(stats, 0, sizeof(ULID_FactoryStats));
+  for (unsigned c = 0; c < percpu->count; ++c) {
+    ULID_FactoryStats_Add(stats, &percpu->slots[c].stats);
+  }
+  return STATS_ENABLED;
+}
+
+void ULID_FactoryStats_Add(ULID_FactoryStats *total,
+                           const ULID_FactoryStats *stats) {
+  total->creations += stats->creations;
+  total->increments += stats->increments;
+  total->entropy_refills += stats->entropy_refills;
+  total->entropy_overflows += stats->entropy_overflows;
+  total->reseeds += stats->reseeds;
+  total->twists += stats->twists;
+  total->clock_regressions += stats->clock_regressions;
+  if (total->max_per_ms < stats->max_per_ms) {
+    total->max_per_ms = stats->max_per_ms;
+  }
+}
+
+/*
+ * We use strictly Crockford's Base32 alphabet when formatting.
+ * Only digits and letters, uppercase unless asked otherwise.
+ * Skip letters I, L, O, U.
+ */
+static const char EncodeUpper[33] = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
+static const char EncodeLower[33] = "0123456789abcdefghjkmnpqrstvwxyz";
 
 #define EncN(p, m) (ulid->data[p] & (m))
 #define EncL(p, m, s) ((ulid->data[p] & (m)) << (s))
 #define EncR(p, m, s) ((ulid->data[p] & (m)) >> (s))
 
-  // 10 byte timestamp
+// 10 characters of timestamp
+static inline void encode_time(const ULID *ulid, char *buf,
+                               const char Encode[33]) {
   buf[0x00] = Encode[EncR(0, 224, 5)];
   buf[0x01] = Encode[EncN(0, 31)];
   buf[0x02] = Encode[EncR(1, 248, 3)];
@@ -158,29 +710,80 @@ unsigned ULID_Format(const ULID *ulid, char buf[ULID_BYTES_FORMATTED]) {
   buf[0x07] = Encode[EncR(4, 124, 2)];
   buf[0x08] = Encode[EncL(4, 3, 3) | EncR(5, 224, 5)];
   buf[0x09] = Encode[EncN(5, 31)];
+}
 
-  // 16 bytes of entropy
-  buf[0x0a] = Encode[EncR(6, 248, 3)];
-  buf[0x0b] = Encode[EncL(6, 7, 2) | EncR(7, 192, 6)];
-  buf[0x0c] = Encode[EncR(7, 62, 1)];
-  buf[0x0d] = Encode[EncL(7, 1, 4) | EncR(8, 240, 4)];
-  buf[0x0e] = Encode[EncL(8, 15, 1) | EncR(9, 128, 7)];
-  buf[0x0f] = Encode[EncR(9, 124, 2)];
-  buf[0x10] = Encode[EncL(9, 3, 3) | EncR(10, 224, 5)];
-  buf[0x11] = Encode[EncN(10, 31)];
-  buf[0x12] = Encode[EncR(11, 248, 3)];
-  buf[0x13] = Encode[EncL(11, 7, 2) | EncR(12, 192, 6)];
-  buf[0x14] = Encode[EncR(12, 62, 1)];
-  buf[0x15] = Encode[EncL(12, 1, 4) | EncR(13, 240, 4)];
-  buf[0x16] = Encode[EncL(13, 15, 1) | EncR(14, 128, 7)];
-  buf[0x17] = Encode[EncR(14, 124, 2)];
-  buf[0x18] = Encode[EncL(14, 3, 3) | EncR(15, 224, 5)];
-  buf[0x19] = Encode[EncN(15, 31)];
+// 16 characters of entropy
+static inline void encode_entropy(const ULID *ulid, char *buf,
+                                  const char Encode[33]) {
+  buf[0x00] = Encode[EncR(6, 248, 3)];
+  buf[0x01] = Encode[EncL(6, 7, 2) | EncR(7, 192, 6)];
+  buf[0x02] = Encode[EncR(7, 62, 1)];
+  buf[0x03] = Encode[EncL(7, 1, 4) | EncR(8, 240, 4)];
+  buf[0x04] = Encode[EncL(8, 15, 1) | EncR(9, 128, 7)];
+  buf[0x05] = Encode[EncR(9, 124, 2)];
+  buf[0x06] = Encode[EncL(9, 3, 3) | EncR(10, 224, 5)];
+  buf[0x07] = Encode[EncN(10, 31)];
+  buf[0x08] = Encode[EncR(11, 248, 3)];
+  buf[0x09] = Encode[EncL(11, 7, 2) | EncR(12, 192, 6)];
+  buf[0x0a] = Encode[EncR(12, 62, 1)];
+  buf[0x0b] = Encode[EncL(12, 1, 4) | EncR(13, 240, 4)];
+  buf[0x0c] = Encode[EncL(13, 15, 1) | EncR(14, 128, 7)];
+  buf[0x0d] = Encode[EncR(14, 124, 2)];
+  buf[0x0e] = Encode[EncL(14, 3, 3) | EncR(15, 224, 5)];
+  buf[0x0f] = Encode[EncN(15, 31)];
+}
+
+unsigned ULID_Format(const ULID *ulid, char buf[ULID_BYTES_FORMATTED]) {
+  return ulid_kernels()->format(ulid, buf);
+}
 
+unsigned ulid_format_scalar(const ULID *ulid, char buf[ULID_BYTES_FORMATTED]) {
+  encode_time(ulid, buf, EncodeUpper);
+  encode_entropy(ulid, buf + ULID_CHARS_TIME, EncodeUpper);
   return ULID_BYTES_FORMATTED;
 }
 
-unsigned ULID_Parse(ULID *ulid, const char str[ULID_BYTES_TOTAL]) {
+char *ULID_ToChars(char *first, char *last, const ULID *ulid,
+                   const char *prefix, unsigned flags) {
+  if (prefix) {
+    for (; *prefix; ++prefix) {
+      if (first >= last) {
+        return 0;
+      }
+      *first++ = *prefix;
+    }
+  }
+
+  unsigned size = ULID_BYTES_FORMATTED;
+  if (flags & ULID_FORMAT_DASHED) {
+    size = ULID_BYTES_FORMATTED_DASHED;
+  }
+  if (last - first < (long)size) {
+    return 0;
+  }
+
+  if (!(flags & (ULID_FORMAT_LOWERCASE | ULID_FORMAT_DASHED))) {
+    return first + ulid_kernels()->format(ulid, first);
+  }
+
+  const char *Encode = EncodeUpper;
+  if (flags & ULID_FORMAT_LOWERCASE) {
+    Encode = EncodeLower;
+  }
+  encode_time(ulid, first, Encode);
+  first += ULID_CHARS_TIME;
+  if (flags & ULID_FORMAT_DASHED) {
+    *first++ = '-';
+  }
+  encode_entropy(ulid, first, Encode);
+  return first + ULID_CHARS_ENTROPY;
+}
+
+unsigned ULID_Parse(ULID *ulid, const char str[ULID_BYTES_FORMATTED]) {
+  return ulid_kernels()->parse(ulid, str);
+}
+
+unsigned ulid_parse_scalar(ULID *ulid, const char str[ULID_BYTES_FORMATTED]) {
   /**
    * Decode stores decimal encodings for characters.
    * 0xFF indicates invalid character.
@@ -273,6 +876,10 @@ unsigned ULID_Parse(ULID *ulid, const char str[ULID_BYTES_TOTAL]) {
 }
 
 int ULID_Compare(const ULID *l, const ULID *r) {
+  return ulid_kernels()->compare(l, r);
+}
+
+int ulid_compare_scalar(const ULID *l, const ULID *r) {
 #define CmpULID(ld, rd, p)                                                     \
   do {                                                                         \
     if (ld[p] != rd[p]) {                                                      \
@@ -309,11 +916,8 @@ int ULID_Compare(const ULID *l, const ULID *r) {
 }
 
 unsigned ULID_GetTime(const ULID *ulid, unsigned long *time_ms) {
-  *time_ms = 0;
-  for (unsigned p = 0; p < ULID_BYTES_TIME; ++p) {
-    *time_ms <<= 8;
-    *time_ms |= ulid->data[p];
-  }
+  // the first 8 bytes, minus the 2 that belong to the entropy
+  *time_ms = load_be64(ulid->data) >> 16;
   return ULID_BYTES_TIME;
 }
 
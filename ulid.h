@@ -1,6 +1,7 @@
 #pragma once
 
 #include "mtwister.h"
+#include <stddef.h>
 #include <stdint.h>
 
 // ULID is a 16 byte Universally-unique Lexicographically-sortable IDentifier.
@@ -11,39 +12,206 @@ enum {
   ULID_BYTES_ENTROPY = 10,
   ULID_BYTES_TIME = 6,
   ULID_BYTES_TOTAL = ULID_BYTES_ENTROPY + ULID_BYTES_TIME,
-  ULID_BYTES_FORMATTED = 26,
+  ULID_CHARS_ENTROPY = 16,
+  ULID_CHARS_TIME = 10,
+  ULID_BYTES_FORMATTED = ULID_CHARS_ENTROPY + ULID_CHARS_TIME,
+  ULID_BYTES_FORMATTED_DASHED = ULID_BYTES_FORMATTED + 1,
+};
+
+// Options for ULID_ToChars(), which can be OR'ed together:
+enum ULID_FormatFlags {
+  ULID_FORMAT_UPPERCASE = 0,      // use uppercase letters (default)
+  ULID_FORMAT_LOWERCASE = 1 << 0, // use lowercase letters
+  ULID_FORMAT_DASHED = 1 << 1,    // separate time and entropy with a '-'
 };
 
 // The kinds of entropy sources we support:
 enum ULID_EntropyKind {
   ULID_ENTROPY_MERSENNE_TWISTER, // use Mersenne Twister
   ULID_ENTROPY_RAND,             // use rand() / srand()
+  ULID_ENTROPY_PHILOX,           // use Philox4x32-10, counter-based (seekable)
+};
+
+// The CPU feature levels for which there are specialized kernels:
+enum ULID_CpuLevel {
+  ULID_CPU_SCALAR, // plain C, works everywhere
+  ULID_CPU_SSE42,  // x86-64 with SSE 4.2
+  ULID_CPU_AVX2,   // x86-64 with AVX2
+  ULID_CPU_AVX512, // x86-64 with AVX-512 F / BW / VL
+  ULID_CPU_LEVELS,
 };
 
+// Counters about the work done by a factory.
+// They are only updated when the library is compiled with -DULID_STATS;
+// otherwise they stay at zero and cost nothing.
+typedef struct ULID_FactoryStats {
+  uint64_t creations;         // ULIDs created
+  uint64_t increments;        // ULIDs created by incrementing the entropy
+  uint64_t entropy_refills;   // ULIDs created with freshly generated entropy
+  uint64_t entropy_overflows; // times incrementing the entropy wrapped around
+  uint64_t reseeds;           // times the PRNG was seeded
+  uint64_t twists;            // times the Mersenne Twister state was renewed
+  uint64_t clock_regressions; // times the clock went backwards
+  uint64_t max_per_ms;        // most ULIDs created within one ms
+} ULID_FactoryStats;          // size:   64 bytes
+
+// The state of a factory used by every ULID created, kept together so that
+// it fits in one cache line; the PRNG state is only used to draw entropy.
+typedef struct ULID_FactoryHot {
+  uint64_t time_ms;                    // size:    8 bytes
+  uint64_t calls;                      // size:    8 bytes
+  uint8_t entropy[ULID_BYTES_ENTROPY]; // size:   10 bytes
+  uint16_t flags;                      // size:    2 bytes
+  uint32_t generation;                 // size:    4 bytes
+  uint32_t seed;                       // size:    4 bytes
+  uint32_t clones;                     // size:    4 bytes
+  uint32_t ulids_per_ms;               // size:    4 bytes
+  uint32_t per_ms;                     // size:    4 bytes (-DULID_STATS)
+} ULID_FactoryHot;                     // size:   48 bytes
+
 // A factory which encapsulates all the state required to generate ULIDs.
 // You can have multiple of these, each with their own configuration.
+// See also ULID_Generator, for an opaque factory allocated by the library.
 typedef struct ULID_Factory {
-  uint64_t time_ms;                    // size:    8 bytes
+  ULID_FactoryHot hot;                 // size:   48 bytes
   MTwister mt;                         // size: 2500 bytes
-  uint32_t seed;                       // size:    4 bytes
-  uint32_t calls;                      // size:    4 bytes
-  uint8_t entropy[ULID_BYTES_ENTROPY]; // size:   10 bytes
-  uint16_t flags;                      // size:    2 bytes
-} ULID_Factory;                        // size: 2528 bytes
+  uint32_t reserved;                   // size:    4 bytes
+  ULID_FactoryStats stats;             // size:   64 bytes
+} ULID_Factory;                        // size: 2616 bytes
+
+// An opaque factory, allocated with ULID_Generator_New(), aligned to a cache
+// line: its hot state takes exactly one line, and the PRNG state starts on
+// the next one.  Best when there are many factories, e.g. one per connection.
+typedef struct ULID_Generator ULID_Generator;
+
+// An opaque set of generators, one per CPU, shared by all threads: memory
+// scales with cores instead of threads, and threads rarely contend.
+typedef struct ULID_PerCpu ULID_PerCpu;
+
+// An opaque generator shared by several processes through a shared-memory
+// file, so that ULIDs are strictly increasing across all of them.
+typedef struct ULID_Shared ULID_Shared;
+
+// An opaque lease daemon, handing out runs of consecutive ULIDs over a Unix
+// socket to clients that cannot share memory (e.g. in other containers).
+typedef struct ULID_LeaseServer ULID_LeaseServer;
+
+// An opaque connection to a lease daemon, creating ULIDs from its leases.
+typedef struct ULID_LeaseClient ULID_LeaseClient;
+
+// An opaque static search tree over sorted ULIDs, laid out so that a search
+// reads one cache line per level of a 5-ary tree; see ULID_STree_New().
+typedef struct ULID_STree ULID_STree;
+
+// An opaque Bloom filter of ULIDs, blocked so that each lookup reads one
+// cache line.  No false negatives; false positives at a rate set by its size.
+typedef struct ULID_BloomFilter ULID_BloomFilter;
+
+// An opaque cuckoo filter of ULIDs, with 16-bit fingerprints: fewer false
+// positives than a Bloom filter of the same size, and ULIDs can be removed.
+typedef struct ULID_CuckooFilter ULID_CuckooFilter;
+
+// How a filter gets its probes from a ULID, see ULID_FilterKeyingFor():
+enum ULID_FilterKeying {
+  ULID_FILTER_ENTROPY, // straight from the entropy bits, which must be random
+  ULID_FILTER_HASH,    // from a hash of the whole ULID
+};
+
+// Options for ULID_Shared_Open(), which can be OR'ed together:
+enum ULID_SharedFlags {
+  ULID_SHARED_DEFAULT = 0,
+  ULID_SHARED_LOCK = 1 << 0, // use a lock instead of a 128-bit CAS
+};
+
+// A full configuration for a factory, for ULID_Factory_Init().
+// Zero values (the default) keep the behaviour of ULID_Factory_Default().
+typedef struct ULID_FactoryConfig {
+  enum ULID_EntropyKind kind; // how to generate entropy
+  uint32_t seed;              // seed for the entropy; 0 => random
+  const uint8_t *entropy;     // ULID_BYTES_ENTROPY fixed bytes; NULL => random
+  unsigned long time_ms;      // fixed time; 0 => current time
+  uint32_t ulids_per_ms;      // with time_ms, use a virtual clock; 0 => fixed
+  int submillisecond;         // sub-ms fraction in the entropy; 0 => no
+} ULID_FactoryConfig;
 
 typedef struct ULID {
   uint8_t data[ULID_BYTES_TOTAL]; // size: 16 bytes
 } ULID;
 
+// A ULID found in text by ULID_Scan().
+typedef struct ULID_ScanMatch {
+  uint64_t offset; // of its first char in the text
+  ULID ulid;       // as decoded
+} ULID_ScanMatch;
+
+// The kinds of violations found by ULID_Verify() and ULID_VerifyText():
+enum ULID_VerifyKind {
+  ULID_VERIFY_UNSORTED,  // less than the ULID before it
+  ULID_VERIFY_DUPLICATE, // equal to the ULID before it
+  ULID_VERIFY_TIME,      // with a time outside the expected window
+  ULID_VERIFY_KINDS,
+};
+
+enum {
+  ULID_VERIFY_FIRST = 8,        // violations kept in a report
+  ULID_VERIFY_PER_MS_LOG2 = 24, // buckets of ULIDs per ms in a report
+};
+
+// A violation found by ULID_Verify() or ULID_VerifyText().
+typedef struct ULID_VerifyViolation {
+  uint64_t index;  // of the ULID in the input, from 0
+  uint64_t offset; // of its first byte in the input
+  ULID ulid;
+  enum ULID_VerifyKind kind;
+} ULID_VerifyViolation;
+
+// What ULID_Verify() and ULID_VerifyText() found.  A run is a stretch of
+// ULIDs in a row with the same time, which in sorted input is all ULIDs of
+// one ms; a chain is a stretch of ULIDs in a row each one more than the one
+// before, as a factory creates by incrementing the entropy.
+typedef struct ULID_VerifyReport {
+  uint64_t count;                         // ULIDs verified
+  uint64_t violations[ULID_VERIFY_KINDS]; // of each kind
+  uint64_t first_count;                   // violations kept in first
+  ULID_VerifyViolation first[ULID_VERIFY_FIRST]; // in input order
+  uint64_t min_ms;                        // earliest time, if count > 0
+  uint64_t max_ms;                        // latest time, if count > 0
+  uint64_t distinct_ms;                   // runs
+  uint64_t max_per_ms;                    // ULIDs in the longest run
+  uint64_t per_ms[ULID_VERIFY_PER_MS_LOG2]; // runs of [2^j, 2^(j+1)) ULIDs;
+                                            // the last bucket has no end
+  uint64_t max_chain;                     // ULIDs in the longest chain
+} ULID_VerifyReport;
+
+// A column of ULIDs stored as a structure of arrays, one entry per ULID in
+// each: scans that only need times (the common case in analytics) read 8
+// bytes per ULID instead of 16, as plain integers.  Rows compare the same as
+// the ULIDs they hold, so a column appended from sorted ULIDs stays sorted.
+typedef struct ULID_Column {
+  uint64_t *time_ms;    // the 48-bit time
+  uint16_t *entropy_hi; // the top 16 bits of the entropy
+  uint64_t *entropy_lo; // the low 64 bits of the entropy
+  size_t count;         // rows in use
+  size_t capacity;      // rows allocated
+} ULID_Column;
+
 #ifndef __cplusplus
 #if __STDC_VERSION__ >= 201112L
 #include <assert.h>
 // ensure there is no padding
-static_assert(sizeof(ULID_Factory) == 2528, "ULID_Factory has size != 2528");
+static_assert(sizeof(ULID_FactoryHot) == 48, "ULID_FactoryHot has size != 48");
+static_assert(sizeof(ULID_Factory) == 2616, "ULID_Factory has size != 2616");
 static_assert(sizeof(ULID) == 16, "ULID has size != 16");
 #endif
 #endif
 
+// Only symbols marked with ULID_API are exported from the shared library.
+#if defined(__GNUC__) || defined(__clang__)
+#define ULID_API __attribute__((visibility("default")))
+#else
+#define ULID_API
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -51,50 +219,452 @@ extern "C" {
 // Initialize a default ULID factory:
 // * Use Mersenne Twister to generate entropy, seeded with gettimeofday().
 // * Use gettimeofday() to generate timestamps in ms.
-void ULID_Factory_Default(ULID_Factory *factory);
+// A factory is safe to use across fork(): the first ULID created in a child
+// process reseeds the entropy generator and draws fresh entropy (unless the
+// entropy was fixed with ULID_Factory_SetEntropy()), so parent and children
+// never generate the same ULIDs.
+// Initializing is cheap: the entropy generator is only seeded when a factory
+// first needs entropy.
+ULID_API void ULID_Factory_Default(ULID_Factory *factory);
+
+// Initialize a ULID factory with a given configuration in one call, which is
+// equivalent to ULID_Factory_Default() followed by the ULID_Factory_Set*()
+// calls for each non-zero field.  A NULL config means all defaults.
+ULID_API void ULID_Factory_Init(ULID_Factory *factory,
+                                const ULID_FactoryConfig *config);
+
+// Initialize a ULID factory as a clone of another one: same entropy kind, and
+// same fixed time and entropy if those were given, but with its own entropy
+// stream, seeded from a value derived from the original factory.  The n-th
+// clone of a factory with an explicit seed always gets the same seed.
+// Cloning does not touch the PRNG state, so it is as cheap as initializing.
+ULID_API void ULID_Factory_Clone(ULID_Factory *clone, ULID_Factory *factory);
 
 // Initialize a ULID factory with a specific entropy kind:
 // * Mersenne Twister, seeded with gettimeofday() (default)
 // * rand() / srand(), seeded with gettimeofday()
-void ULID_Factory_SetEntropyKind(ULID_Factory *factory,
-                                 const enum ULID_EntropyKind kind);
+// * Philox4x32-10, where the entropy drawn for the n-th ULID is a pure
+//   function of (seed, n), see ULID_Factory_Seek()
+ULID_API void ULID_Factory_SetEntropyKind(ULID_Factory *factory,
+                                          const enum ULID_EntropyKind kind);
 
 // Initialize a ULID factory where the entropy uses a specific seed.
-void ULID_Factory_SetEntropySeed(ULID_Factory *factory, const uint32_t seed);
+ULID_API void ULID_Factory_SetEntropySeed(ULID_Factory *factory,
+                                          const uint32_t seed);
 
 // Initialize a ULID factory where the starting entropy is given.
-void ULID_Factory_SetEntropy(ULID_Factory *factory,
-                             const uint8_t entropy[ULID_BYTES_ENTROPY]);
+ULID_API void ULID_Factory_SetEntropy(ULID_Factory *factory,
+                                      const uint8_t entropy[ULID_BYTES_ENTROPY]);
 
 // Initialize a ULID factory where the starting time is given.
-void ULID_Factory_SetTime(ULID_Factory *factory, const unsigned long time_ms);
+ULID_API void ULID_Factory_SetTime(ULID_Factory *factory,
+                                   const unsigned long time_ms);
+
+// Initialize a ULID factory to keep sub-millisecond precision: when reading
+// the clock, the fraction of the current ms, in 1/4096 ms (about 244ns), goes
+// into the top 12 bits of fresh entropy, which is drawn at every new fraction
+// instead of every new ms.  ULIDs are still valid and sortable, but fewer of
+// them share one increment chain, and ULIDs from different factories (and
+// threads, or processes) are sorted to within 244ns instead of 1ms.
+// Costs clock_gettime() instead of gettimeofday(), and more entropy draws.
+// Has no effect with a fixed time or fixed entropy.
+ULID_API void ULID_Factory_SetSubMillisecond(ULID_Factory *factory,
+                                             const int enabled);
+
+// Initialize a ULID factory with a virtual clock: it starts at time_ms, and
+// moves forward one ms every ulids_per_ms ULIDs, so the time of the n-th ULID
+// is time_ms + n / ulids_per_ms.  A ulids_per_ms of 0 means a fixed time, as
+// with ULID_Factory_SetTime().
+ULID_API void ULID_Factory_SetVirtualTime(ULID_Factory *factory,
+                                          const unsigned long time_ms,
+                                          const uint32_t ulids_per_ms);
+
+// Position a factory so that the next ULID it creates is the n-th one (from
+// 0) of its sequence, exactly as if it had created the previous n ULIDs.
+// This takes constant time, so several threads, each with its own factory
+// configured the same way, can create disjoint slices of one sequence in
+// parallel and get bit-identical results to a single thread.
+// Only possible with ULID_ENTROPY_PHILOX and a fixed or virtual time, without
+// fixed entropy; return 1 if the factory could seek, 0 otherwise.
+ULID_API int ULID_Factory_Seek(ULID_Factory *factory, const uint64_t n);
 
 // Create a ULID with the factory as configured.
-void ULID_Create(ULID_Factory *factory, ULID *ulid);
+ULID_API void ULID_Create(ULID_Factory *factory, ULID *ulid);
+
+// Create n ULIDs with the given times (in ms) instead of the factory's clock,
+// for instance to backfill ULIDs for existing rows from their own timestamps.
+// Equivalent to ULID_Factory_SetTime() + ULID_Create() for each time, but much
+// faster: runs of equal times (sorted input) draw entropy once and increment
+// it for the rest of the run; any other time draws fresh entropy, so unsorted
+// input works too, but ULIDs are only sorted within runs of equal times.
+// Afterwards the factory is left as if it had created the last ULID; a
+// factory with a fixed or virtual time keeps the last time as a fixed time.
+ULID_API void ULID_CreateAt(ULID_Factory *factory, const uint64_t *times_ms,
+                            ULID *out, size_t n);
+
+// Allocate and initialize a generator with a given configuration, as with
+// ULID_Factory_Init(); a NULL config means all defaults.
+// Return NULL if out of memory.
+ULID_API ULID_Generator *ULID_Generator_New(const ULID_FactoryConfig *config);
+
+// Free a generator allocated with ULID_Generator_New().
+ULID_API void ULID_Generator_Free(ULID_Generator *generator);
+
+// Same as ULID_Create(), ULID_CreateAt() and ULID_Factory_GetStats(), for a
+// generator.
+ULID_API void ULID_Generator_Create(ULID_Generator *generator, ULID *ulid);
+ULID_API void ULID_Generator_CreateAt(ULID_Generator *generator,
+                                      const uint64_t *times_ms, ULID *out,
+                                      size_t n);
+ULID_API int ULID_Generator_GetStats(const ULID_Generator *generator,
+                                     ULID_FactoryStats *stats);
+
+// Allocate and initialize one generator per configured CPU, each with the
+// given configuration but its own seed, derived from the configured one as
+// with ULID_Factory_Clone(); a NULL config means all defaults.  A fixed
+// entropy in the config is ignored: generators on different CPUs would create
+// the same ULIDs in the same ms, so each one draws entropy from its seed.
+// Return NULL if out of memory.
+ULID_API ULID_PerCpu *ULID_PerCpu_New(const ULID_FactoryConfig *config);
+
+// Free per-CPU generators allocated with ULID_PerCpu_New().
+ULID_API void ULID_PerCpu_Free(ULID_PerCpu *percpu);
+
+// Create a ULID with the generator of the CPU the calling thread runs on;
+// safe to call from any number of threads.  If that generator is busy (the
+// thread moved to another CPU, or another thread was preempted while using
+// it), the next free one is used instead of waiting.
+// ULIDs are sorted per generator, so two ULIDs created by the same thread in
+// the same ms may be out of order if the thread moved between CPUs.
+ULID_API void ULID_PerCpu_Create(ULID_PerCpu *percpu, ULID *ulid);
+
+// Get the counters for all per-CPU generators, added together.
+// Return 1 if the library was compiled with -DULID_STATS, 0 otherwise.
+ULID_API int ULID_PerCpu_GetStats(const ULID_PerCpu *percpu,
+                                  ULID_FactoryStats *stats);
+
+// Open a generator shared by all processes that open the same path, usually
+// a file under /dev/shm, creating and initializing the file if needed.  The
+// last ULID issued by any process lives in the file, and each new ULID is the
+// greater of one drawn from a private factory (with the given configuration,
+// or all defaults if NULL) and that last ULID plus one, published with a
+// 128-bit compare-and-swap -- or with a robust lock, which survives processes
+// dying while holding it, if the CPU has no such CAS or ULID_SHARED_LOCK is
+// given.  Flags only matter to the process that creates the file.
+// Return NULL, with errno set, if the file could not be opened and mapped.
+// The file is never removed; unlink() it when no process needs it.
+ULID_API ULID_Shared *ULID_Shared_Open(const char *path,
+                                       const ULID_FactoryConfig *config,
+                                       const unsigned flags);
+
+// Unmap and free a generator opened with ULID_Shared_Open().
+ULID_API void ULID_Shared_Close(ULID_Shared *shared);
+
+// Create a ULID greater than any other created through the same file.
+// Like a factory, a ULID_Shared must not be used by several threads at once;
+// give each thread its own, opened on the same path.  It can be used across
+// fork(), where the child keeps sharing the file with its parent.
+// Contended, this costs a cache line bouncing between CPUs for every ULID.
+// Return 1 on success, or 0, with errno set, if the lock could not be taken
+// (ENOTRECOVERABLE: a process died holding it and it was then given up); no
+// ULID is created then, as it could not be ordered after the others.
+ULID_API int ULID_Shared_Create(ULID_Shared *shared, ULID *ulid);
+
+// Start a lease daemon listening on a Unix socket at path; a socket file left
+// behind by a dead daemon is replaced, but nothing else at path is.  Each
+// lease is a run of consecutive ULIDs (read as numbers) sharing one time: the
+// first one is the greater of a ULID from the daemon's factory (with the
+// given configuration, or all defaults if NULL) and the last ULID it leased
+// plus one, so leases never overlap and each one starts after all earlier
+// ones.
+// Return NULL, with errno set, if the socket could not be set up; EADDRINUSE
+// means another daemon is already listening there, EEXIST that path is taken
+// by something other than a dead daemon's socket.
+ULID_API ULID_LeaseServer *ULID_LeaseServer_Open(
+    const char *path, const ULID_FactoryConfig *config);
+
+// Wait up to timeout_ms (-1: forever) for clients, accept new ones and answer
+// all pending requests.  Call in a loop, checking whatever tells the daemon
+// to stop between calls.
+// Return the number of leases granted, or -1 on error.
+ULID_API int ULID_LeaseServer_Serve(ULID_LeaseServer *server,
+                                    const int timeout_ms);
+
+// Stop a lease daemon, closing all connections and removing the socket.
+ULID_API void ULID_LeaseServer_Close(ULID_LeaseServer *server);
+
+// Connect to the lease daemon listening at path.
+// Return NULL, with errno set, if it could not connect.
+ULID_API ULID_LeaseClient *ULID_LeaseClient_Open(const char *path);
+
+// Close a connection opened with ULID_LeaseClient_Open().
+ULID_API void ULID_LeaseClient_Close(ULID_LeaseClient *client);
+
+// Create a ULID from the current lease, taking a new lease (one round trip)
+// when it is used up or older than 10ms, so ULIDs are sorted per client and
+// their time is at most that far behind.  Lease sizes adapt to the rate of
+// creation: they double while a lease lasts less than about 1ms, and halve
+// while it lasts much longer; up to 65536 ULIDs per round trip.
+// Like a factory, a client must not be used by several threads at once.  It
+// can be used across fork(): the child connects again and takes new leases.
+// Return 1 on success, or 0, with errno set, if the daemon cannot be reached.
+ULID_API int ULID_LeaseClient_Create(ULID_LeaseClient *client, ULID *ulid);
+
+// Take one lease of up to count ULIDs (one round trip), with the first ULID
+// in first; the rest follow by incrementing it as a number.  A count of 0 is
+// taken as 1.
+// Return how many ULIDs were granted, or 0, with errno set, on error
+// (ECONNRESET if the daemon went away).
+ULID_API uint32_t ULID_LeaseClient_Lease(ULID_LeaseClient *client,
+                                         const uint32_t count, ULID *first);
+
+// Get a copy of the counters for a factory.
+// Return 1 if the library was compiled with -DULID_STATS, 0 otherwise.
+ULID_API int ULID_Factory_GetStats(const ULID_Factory *factory,
+                                   ULID_FactoryStats *stats);
+
+// Add the counters for a factory into a total, to aggregate several of them.
+// The total of max_per_ms is the largest one.
+ULID_API void ULID_FactoryStats_Add(ULID_FactoryStats *total,
+                                    const ULID_FactoryStats *stats);
 
 // Get a ULID's time component.
-unsigned ULID_GetTime(const ULID *ulid, unsigned long *time_ms);
+ULID_API unsigned ULID_GetTime(const ULID *ulid, unsigned long *time_ms);
 
 // Get a ULID's entropy component.
-unsigned ULID_GetEntropy(const ULID *ulid, uint8_t entropy[ULID_BYTES_ENTROPY]);
+ULID_API unsigned ULID_GetEntropy(const ULID *ulid,
+                                  uint8_t entropy[ULID_BYTES_ENTROPY]);
+
+// Get the time component of n ULIDs, using SIMD to extract several at once.
+ULID_API void ULID_GetTimeMany(const ULID *ulids, const size_t n,
+                               uint64_t *times_ms);
+
+// Get the minimum and maximum of n times, e.g. a ULID_Column's time_ms, with
+// SIMD.  Return 0 if n is 0 (and leave min_ms and max_ms alone), 1 otherwise.
+ULID_API int ULID_TimeRange(const uint64_t *times_ms, const size_t n,
+                            uint64_t *min_ms, uint64_t *max_ms);
+
+// Count n times into buckets of bucket_ms each, the first one starting at
+// start_ms: add to counts[(time - start_ms) / bucket_ms], skipping times
+// before start_ms or past the last bucket.  Counts are added to, not reset,
+// so several arrays of times (e.g. slices of a column) can be counted in turn.
+ULID_API void ULID_TimeHistogram(const uint64_t *times_ms, const size_t n,
+                                 const uint64_t start_ms,
+                                 const uint64_t bucket_ms, uint64_t *counts,
+                                 const size_t buckets);
+
+// Initialize an empty column with room for capacity ULIDs.
+// Return 1 on success, 0 if out of memory.
+ULID_API int ULID_Column_Init(ULID_Column *column, const size_t capacity);
+
+// Free the arrays of a column, leaving it empty.
+ULID_API void ULID_Column_Free(ULID_Column *column);
+
+// Append n ULIDs to a column, growing it as needed.
+// Return 1 on success, 0 if out of memory (and the column is unchanged).
+ULID_API int ULID_Column_Append(ULID_Column *column, const ULID *ulids,
+                                const size_t n);
+
+// Get the ULIDs in rows [first, first + n) of a column.
+ULID_API void ULID_Column_Get(const ULID_Column *column, const size_t first,
+                              const size_t n, ULID *out);
+
+// Compare the ULIDs in rows l and r of a column, as ULID_Compare() would.
+ULID_API int ULID_Column_Compare(const ULID_Column *column, const size_t l,
+                                 const size_t r);
+
+// Return 1 if the rows of a column are sorted, 0 otherwise.
+ULID_API int ULID_Column_IsSorted(const ULID_Column *column);
+
+// In a sorted column, return the first row not less than a ULID, or count.
+ULID_API size_t ULID_Column_LowerBound(const ULID_Column *column,
+                                       const ULID *ulid);
+
+// In a sorted column, return the first row with a time not less than
+// time_ms, or count; only reads time_ms.
+ULID_API size_t ULID_Column_TimeLowerBound(const ULID_Column *column,
+                                           const uint64_t time_ms);
+
+// Build a search tree over count ULIDs sorted as by ULID_Compare() (maybe
+// with duplicates), copying them: the array is not needed afterwards.  Takes
+// about 1.25 times the memory of the array.  Return NULL if out of memory.
+ULID_API ULID_STree *ULID_STree_New(const ULID *sorted, const size_t count);
+
+// Free a search tree.
+ULID_API void ULID_STree_Free(ULID_STree *tree);
+
+// Get the number of ULIDs in a search tree.
+ULID_API size_t ULID_STree_Count(const ULID_STree *tree);
+
+// Return the rank (the index in the sorted array) of the first ULID not less
+// than a ULID, or the count if there is none, as std::lower_bound() would.
+ULID_API size_t ULID_STree_LowerBound(const ULID_STree *tree,
+                                      const ULID *ulid);
+
+// Same as ULID_STree_LowerBound() for n ULIDs, setting ranks[j] for
+// ulids[j]; searches for a group of ULIDs are interleaved, which hides most
+// cache misses on trees larger than the caches.
+ULID_API void ULID_STree_LowerBoundMany(const ULID_STree *tree,
+                                        const ULID *ulids, const size_t n,
+                                        size_t *ranks);
+
+// Return the rank of the first copy of a ULID, or the count if it is not in
+// the tree.
+ULID_API size_t ULID_STree_Find(const ULID_STree *tree, const ULID *ulid);
 
 // Format a ULID's printable representation into a text buffer.
 // Buffer must be at least ULID_BYTES_FORMATTED long.
 // Buffer will NOT be zero-terminated.
 // Return number of bytes generated.
-unsigned ULID_Format(const ULID *ulid, char buf[ULID_BYTES_FORMATTED]);
+ULID_API unsigned ULID_Format(const ULID *ulid,
+                              char buf[ULID_BYTES_FORMATTED]);
+
+// Format a ULID's printable representation into the text buffer [first, last),
+// in the style of std::to_chars():
+// * If prefix is not NULL, it is copied verbatim before the ULID.
+// * Flags are a combination of ULID_FormatFlags values.
+// * Buffer will NOT be zero-terminated.
+// Return a pointer one past the last byte written, or NULL if the buffer is
+// too small (and then the buffer contents are unspecified).
+ULID_API char *ULID_ToChars(char *first, char *last, const ULID *ulid,
+                            const char *prefix, unsigned flags);
 
 // Parse a ULID from a string with its printable representation.
 // String must be at least ULID_BYTES_FORMATTED long.
 // String does NOT have to be zero-terminated.
 // Return number of bytes generated.
-unsigned ULID_Parse(ULID *ulid, const char str[ULID_BYTES_TOTAL]);
+ULID_API unsigned ULID_Parse(ULID *ulid, const char str[ULID_BYTES_FORMATTED]);
+
+// Find the ULIDs in text[*pos, size), e.g. a whole log file mapped with
+// mmap(): runs of exactly 26 chars accepted by ULID_Parse() (ASCII letters
+// and digits), not touching other such chars on either side, and starting
+// with '0' to '7' (anything higher overflows 128 bits).  Only those with a
+// time in [min_ms, max_ms] are kept; pass 0 and UINT64_MAX to keep all.
+// Store up to capacity of them in matches and return how many; *pos is left
+// where the next call must continue, which is size once all text is done.
+// Text is classified 64 chars at a time with SIMD, see ULID_GetCpuLevel().
+ULID_API size_t ULID_Scan(const char *text, const size_t size, size_t *pos,
+                          const uint64_t min_ms, const uint64_t max_ms,
+                          ULID_ScanMatch *matches, const size_t capacity);
+
+// Get the keying for filters of ULIDs created with a config: ULIDs with fixed
+// or seeded entropy, with a sub-ms fraction in it, or with entropy from
+// rand() (not all bits random), must be hashed; others can be keyed on their
+// random entropy, which saves the hashing.
+ULID_API enum ULID_FilterKeying
+ULID_FilterKeyingFor(const ULID_FactoryConfig *config);
+
+// Allocate an empty Bloom filter for capacity ULIDs at bits_per_ulid bits
+// each (0 => 16, for about 0.1% false positives), rounded up to a power of 2
+// of 64-byte blocks.  Return NULL if out of memory.
+ULID_API ULID_BloomFilter *
+ULID_BloomFilter_New(const size_t capacity, const unsigned bits_per_ulid,
+                     const enum ULID_FilterKeying keying);
+
+// Map a Bloom filter saved with ULID_BloomFilter_Save(), using it in place.
+// If writable, ULIDs added go to the file; if not, none may be added.
+// Return NULL (see errno) on error, EINVAL if the file is not such a filter.
+ULID_API ULID_BloomFilter *ULID_BloomFilter_Open(const char *path,
+                                                 const int writable);
+
+// Free a Bloom filter, or unmap it if it was opened from a file.
+ULID_API void ULID_BloomFilter_Free(ULID_BloomFilter *filter);
+
+// Save a Bloom filter to a file, for ULID_BloomFilter_Open().
+// Return 1 on success, 0 (see errno) on error.
+ULID_API int ULID_BloomFilter_Save(const ULID_BloomFilter *filter,
+                                   const char *path);
+
+// Add a ULID, or n of them, prefetching their blocks a batch at a time.
+// Lookups may run in several threads at once, but adding needs just one.
+ULID_API void ULID_BloomFilter_Add(ULID_BloomFilter *filter, const ULID *ulid);
+ULID_API void ULID_BloomFilter_AddMany(ULID_BloomFilter *filter,
+                                       const ULID *ulids, const size_t n);
+
+// Return 1 if a ULID may have been added, 0 if it surely was not.
+ULID_API int ULID_BloomFilter_Contains(const ULID_BloomFilter *filter,
+                                       const ULID *ulid);
+
+// Look up n ULIDs, prefetching their blocks a batch at a time, which hides
+// most of the cache misses of a large filter.  Set found[j] as
+// ULID_BloomFilter_Contains() would for ulids[j]; return how many are found.
+ULID_API size_t ULID_BloomFilter_ContainsMany(const ULID_BloomFilter *filter,
+                                              const ULID *ulids,
+                                              const size_t n, uint8_t *found);
+
+// Get the number of ULIDs added to a Bloom filter.
+ULID_API uint64_t ULID_BloomFilter_Count(const ULID_BloomFilter *filter);
+
+// Allocate an empty cuckoo filter for capacity ULIDs, at 2 bytes each,
+// rounded up to a power of 2 of 8-byte buckets.  Return NULL if out of memory.
+ULID_API ULID_CuckooFilter *
+ULID_CuckooFilter_New(const size_t capacity,
+                      const enum ULID_FilterKeying keying);
+
+// Same as ULID_BloomFilter_Open(), ULID_BloomFilter_Free() and
+// ULID_BloomFilter_Save(), for a cuckoo filter.
+ULID_API ULID_CuckooFilter *ULID_CuckooFilter_Open(const char *path,
+                                                   const int writable);
+ULID_API void ULID_CuckooFilter_Free(ULID_CuckooFilter *filter);
+ULID_API int ULID_CuckooFilter_Save(const ULID_CuckooFilter *filter,
+                                    const char *path);
+
+// Add a ULID to a cuckoo filter; adding it twice stores it twice.
+// Return 1 on success, 0 if the filter is full (and the ULID was not added).
+ULID_API int ULID_CuckooFilter_Add(ULID_CuckooFilter *filter,
+                                   const ULID *ulid);
+
+// Remove a ULID that was added; removing one that was not can remove
+// another ULID that shares its fingerprint.
+// Return 1 if it was found and removed, 0 otherwise.
+ULID_API int ULID_CuckooFilter_Remove(ULID_CuckooFilter *filter,
+                                      const ULID *ulid);
+
+// Same as ULID_BloomFilter_Contains(), ULID_BloomFilter_ContainsMany() and
+// ULID_BloomFilter_Count(), for a cuckoo filter.
+ULID_API int ULID_CuckooFilter_Contains(const ULID_CuckooFilter *filter,
+                                        const ULID *ulid);
+ULID_API size_t ULID_CuckooFilter_ContainsMany(
+    const ULID_CuckooFilter *filter, const ULID *ulids, const size_t n,
+    uint8_t *found);
+ULID_API uint64_t ULID_CuckooFilter_Count(const ULID_CuckooFilter *filter);
+
+// Verify that n ULIDs are strictly increasing (and so unique) and all have a
+// time in [min_ms, max_ms], and gather statistics about them into a report.
+// The ULIDs are cut into slices verified by up to threads threads at once
+// (0 => one per CPU), then stitched together: the report is the same for any
+// number of threads.  Return 1 if there is no violation, 0 otherwise.
+ULID_API int ULID_Verify(const ULID *ulids, const size_t n,
+                         const uint64_t min_ms, const uint64_t max_ms,
+                         const unsigned threads, ULID_VerifyReport *report);
+
+// Same as ULID_Verify() for the ULIDs found in text, e.g. a file with one
+// ULID per line mapped with mmap(), as ULID_Scan() finds them; offsets in
+// the report are those of ULIDs in the text.
+ULID_API int ULID_VerifyText(const char *text, const size_t size,
+                             const uint64_t min_ms, const uint64_t max_ms,
+                             const unsigned threads,
+                             ULID_VerifyReport *report);
 
 // Compare two ULIDs Lexicographically, returning:
 //   l <  r => -1
 //   l == r => 0
 //   l >  r => +1
-int ULID_Compare(const ULID *l, const ULID *r);
+ULID_API int ULID_Compare(const ULID *l, const ULID *r);
+
+// Get the CPU level used by ULID_Format(), ULID_Parse(), ULID_Compare() and
+// the entropy generator.  By default this is the best level supported by the
+// running CPU, detected on first use; it can be forced by setting envvar
+// ULID_CPU_LEVEL to "scalar", "sse4.2", "avx2" or "avx512".
+ULID_API enum ULID_CpuLevel ULID_GetCpuLevel(void);
+
+// Force a CPU level, for all threads; mostly useful for testing.
+// A level higher than what the CPU supports is lowered to the best one it does.
+// Return the level actually in use.
+ULID_API enum ULID_CpuLevel ULID_SetCpuLevel(const enum ULID_CpuLevel level);
+
+// Get a printable name for a CPU level.
+ULID_API const char *ULID_CpuLevelName(const enum ULID_CpuLevel level);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ * {fmt} support for ULIDs, for C++ code that uses fmt-style formatting.
+ *
+ * Format specs (can be combined):
+ *   {}   => 01JEV0N6VMFJ1BBR0Y46BE4RRN
+ *   {:l} => 01jev0n6vmfj1bbr0y46be4rrn
+ *   {:d} => 01JEV0N6VM-FJ1BBR0Y46BE4RRN
+ *
+ * Only the public {fmt} API is used: the ULID is encoded into a small local
+ * buffer and copied out, which {fmt} appends in one go when the output is a
+ * contiguous buffer (fmt::memory_buffer, std::string, etc.).
+ */
+
+#include <algorithm>
+#include <fmt/format.h>
+
+#include "ulid.h"
+
+template <> struct fmt::formatter<ULID> {
+  unsigned flags = ULID_FORMAT_UPPERCASE;
+
+  constexpr auto parse(format_parse_context &ctx) -> decltype(ctx.begin()) {
+    auto it = ctx.begin();
+    for (; it != ctx.end() && *it != '}'; ++it) {
+      switch (*it) {
+      case 'u':
+        flags &= ~ULID_FORMAT_LOWERCASE;
+        break;
+      case 'l':
+        flags |= ULID_FORMAT_LOWERCASE;
+        break;
+      case 'd':
+        flags |= ULID_FORMAT_DASHED;
+        break;
+      default:
+        throw format_error("invalid format spec for ULID");
+      }
+    }
+    return it;
+  }
+
+  template <typename FormatContext>
+  auto format(const ULID &ulid, FormatContext &ctx) const
+      -> decltype(ctx.out()) {
+    char buf[ULID_BYTES_FORMATTED_DASHED];
+    char *end = ULID_ToChars(buf, buf + sizeof(buf), &ulid, nullptr, flags);
+    return std::copy(buf, end, ctx.out());
+  }
+};
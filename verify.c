@@ -0,0 +1,293 @@
+#include "verify.h"
+#include "ulid.h"
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+// Slices are at least this many ULIDs (or 32 times as many bytes of text),
+// so that threads are worth starting.
+#define MIN_SLICE 65536
+
+// ULIDs found in text per call to ULID_Scan().
+#define SCAN_BATCH 512
+
+#define TIME_SHIFT (8 * ULID_BYTES_ENTROPY)
+
+typedef struct Slice {
+  ULID_VerifySegment segment;
+  const void *input; // ULIDs or text
+  size_t size;       // of the whole input, in ULIDs or bytes
+  size_t begin;      // of the slice
+  size_t end;
+  uint64_t min_ms;
+  uint64_t max_ms;
+} Slice;
+
+static void add_violation(ULID_VerifyReport *report,
+                          const enum ULID_VerifyKind kind,
+                          const uint64_t index, const uint64_t offset,
+                          const ULID *ulid) {
+  ++report->violations[kind];
+  if (report->first_count < ULID_VERIFY_FIRST) {
+    ULID_VerifyViolation *v = &report->first[report->first_count++];
+    v->index = index;
+    v->offset = offset;
+    v->ulid = *ulid;
+    v->kind = kind;
+  }
+}
+
+static void count_run(ULID_VerifyReport *report, const uint64_t run) {
+  unsigned log2 = 63 - __builtin_clzll(run);
+  if (log2 >= ULID_VERIFY_PER_MS_LOG2) {
+    log2 = ULID_VERIFY_PER_MS_LOG2 - 1;
+  }
+  ++report->per_ms[log2];
+  ++report->distinct_ms;
+  if (run > report->max_per_ms) {
+    report->max_per_ms = run;
+  }
+}
+
+static void check_order(ULID_VerifyReport *report, const ulid_u128 last,
+                        const ulid_u128 next, const uint64_t index,
+                        const uint64_t offset, const ULID *ulid) {
+  if (next <= last) {
+    add_violation(report,
+                  next == last ? ULID_VERIFY_DUPLICATE : ULID_VERIFY_UNSORTED,
+                  index, offset, ulid);
+  }
+}
+
+// Verify the next ULID of a segment.
+static void feed(ULID_VerifySegment *segment, const ULID *ulid,
+                 const uint64_t offset, const uint64_t min_ms,
+                 const uint64_t max_ms) {
+  ULID_VerifyReport *report = &segment->report;
+  const ulid_u128 next = ulid_to_number(ulid);
+  const uint64_t time_ms = (uint64_t)(next >> TIME_SHIFT);
+  const uint64_t index = report->count;
+  if (index == 0) {
+    segment->first_offset = offset;
+    segment->first = next;
+    segment->first_run = segment->last_run = 1;
+    segment->first_chain = segment->last_chain = 1;
+    report->min_ms = report->max_ms = time_ms;
+    report->max_chain = 1;
+  } else {
+    const ulid_u128 last = segment->last;
+    check_order(report, last, next, index, offset, ulid);
+    const int whole_run = segment->last_run == index;
+    if ((uint64_t)(last >> TIME_SHIFT) == time_ms) {
+      ++segment->last_run;
+      segment->first_run += whole_run;
+    } else {
+      if (!whole_run) {
+        count_run(report, segment->last_run);
+      }
+      segment->last_run = 1;
+    }
+    const int whole_chain = segment->last_chain == index;
+    if (next == last + 1) {
+      ++segment->last_chain;
+      segment->first_chain += whole_chain;
+    } else {
+      segment->last_chain = 1;
+    }
+    if (segment->last_chain > report->max_chain) {
+      report->max_chain = segment->last_chain;
+    }
+    report->min_ms = time_ms < report->min_ms ? time_ms : report->min_ms;
+    report->max_ms = time_ms > report->max_ms ? time_ms : report->max_ms;
+  }
+  if (time_ms < min_ms || time_ms > max_ms) {
+    add_violation(report, ULID_VERIFY_TIME, index, offset, ulid);
+  }
+  segment->last = next;
+  ++report->count;
+}
+
+// Append segment b to segment a, as if b's ULIDs had been fed to a.
+static void merge(ULID_VerifySegment *a, const ULID_VerifySegment *b) {
+  ULID_VerifyReport *ra = &a->report;
+  const ULID_VerifyReport *rb = &b->report;
+  if (rb->count == 0) {
+    return;
+  }
+  if (ra->count == 0) {
+    *a = *b;
+    return;
+  }
+  const uint64_t base = ra->count;
+  ULID first;
+  ulid_from_number(&first, b->first);
+  check_order(ra, a->last, b->first, base, b->first_offset, &first);
+  for (unsigned k = 0; k < ULID_VERIFY_KINDS; ++k) {
+    ra->violations[k] += rb->violations[k];
+  }
+  for (uint64_t v = 0;
+       v < rb->first_count && ra->first_count < ULID_VERIFY_FIRST; ++v) {
+    ra->first[ra->first_count] = rb->first[v];
+    ra->first[ra->first_count++].index += base;
+  }
+
+  const int a_run = a->first_run == ra->count;
+  const int b_run = b->first_run == rb->count;
+  if (a->last >> TIME_SHIFT == b->first >> TIME_SHIFT) {
+    // the runs at the ends meet: one run, counted once it is closed
+    if (!a_run && !b_run) {
+      count_run(ra, a->last_run + b->first_run);
+    }
+    a->first_run += a_run ? b->first_run : 0;
+    a->last_run = b_run ? a->last_run + rb->count : b->last_run;
+  } else {
+    if (!a_run) {
+      count_run(ra, a->last_run);
+    }
+    if (!b_run) {
+      count_run(ra, b->first_run);
+    }
+    a->last_run = b->last_run;
+  }
+  for (unsigned j = 0; j < ULID_VERIFY_PER_MS_LOG2; ++j) {
+    ra->per_ms[j] += rb->per_ms[j];
+  }
+  ra->distinct_ms += rb->distinct_ms;
+  if (rb->max_per_ms > ra->max_per_ms) {
+    ra->max_per_ms = rb->max_per_ms;
+  }
+
+  const int a_chain = a->first_chain == ra->count;
+  const int b_chain = b->first_chain == rb->count;
+  if (b->first == a->last + 1) {
+    uint64_t joined = a->last_chain + b->first_chain;
+    if (joined > ra->max_chain) {
+      ra->max_chain = joined;
+    }
+    a->first_chain += a_chain ? b->first_chain : 0;
+    a->last_chain = b_chain ? a->last_chain + rb->count : b->last_chain;
+  } else {
+    a->last_chain = b->last_chain;
+  }
+  if (rb->max_chain > ra->max_chain) {
+    ra->max_chain = rb->max_chain;
+  }
+
+  ra->min_ms = rb->min_ms < ra->min_ms ? rb->min_ms : ra->min_ms;
+  ra->max_ms = rb->max_ms > ra->max_ms ? rb->max_ms : ra->max_ms;
+  ra->count += rb->count;
+  a->last = b->last;
+}
+
+// Count the runs still open at the ends of the only segment left.
+static void close_runs(ULID_VerifySegment *segment) {
+  ULID_VerifyReport *report = &segment->report;
+  if (report->count == 0) {
+    return;
+  }
+  count_run(report, segment->first_run);
+  if (segment->first_run < report->count) {
+    count_run(report, segment->last_run);
+  }
+}
+
+static void *verify_ulids(void *arg) {
+  Slice *slice = (Slice *)arg;
+  const ULID *ulids = (const ULID *)slice->input;
+  for (size_t j = slice->begin; j < slice->end; ++j) {
+    feed(&slice->segment, &ulids[j], (uint64_t)j * sizeof(ULID),
+         slice->min_ms, slice->max_ms);
+  }
+  return 0;
+}
+
+static void *verify_text(void *arg) {
+  Slice *slice = (Slice *)arg;
+  const char *text = (const char *)slice->input;
+  // A ULID starting in the slice is known to end where it seems to once the
+  // char after it is read, at most ULID_BYTES_FORMATTED chars past the end;
+  // the text after that does not matter.
+  size_t limit = slice->end + ULID_BYTES_FORMATTED;
+  if (limit > slice->size) {
+    limit = slice->size;
+  }
+  ULID_ScanMatch matches[SCAN_BATCH];
+  size_t pos = slice->begin;
+  while (pos < slice->end) {
+    size_t found = ULID_Scan(text, limit, &pos, 0, UINT64_MAX, matches,
+                             SCAN_BATCH);
+    for (size_t m = 0; m < found; ++m) {
+      if (matches[m].offset >= slice->end) {
+        return 0;
+      }
+      feed(&slice->segment, &matches[m].ulid, matches[m].offset,
+           slice->min_ms, slice->max_ms);
+    }
+  }
+  return 0;
+}
+
+static int verify(void *(*worker)(void *), const void *input,
+                  const size_t size, const size_t min_slice,
+                  const uint64_t min_ms, const uint64_t max_ms,
+                  unsigned threads, ULID_VerifyReport *report) {
+  enum {
+    MAX_THREADS = 64,
+  };
+  if (threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (unsigned)cpus : 1;
+  }
+  if (threads > MAX_THREADS) {
+    threads = MAX_THREADS;
+  }
+  if (threads > size / min_slice) {
+    threads = size / min_slice > 0 ? (unsigned)(size / min_slice) : 1;
+  }
+  Slice slices[MAX_THREADS];
+  pthread_t ids[MAX_THREADS];
+  int started[MAX_THREADS];
+  for (unsigned t = 0; t < threads; ++t) {
+    Slice *slice = &slices[t];
+    memset(&slice->segment, 0, sizeof(slice->segment));
+    slice->input = input;
+    slice->size = size;
+    slice->begin = size / threads * t;
+    slice->end = t + 1 < threads ? size / threads * (t + 1) : size;
+    slice->min_ms = min_ms;
+    slice->max_ms = max_ms;
+    // the first slice runs here; if a thread cannot start, so does its slice
+    started[t] = t > 0 && pthread_create(&ids[t], 0, worker, slice) == 0;
+  }
+  worker(&slices[0]);
+  for (unsigned t = 1; t < threads; ++t) {
+    if (started[t]) {
+      pthread_join(ids[t], 0);
+    } else {
+      worker(&slices[t]);
+    }
+    merge(&slices[0].segment, &slices[t].segment);
+  }
+  close_runs(&slices[0].segment);
+  *report = slices[0].segment.report;
+  for (unsigned k = 0; k < ULID_VERIFY_KINDS; ++k) {
+    if (report->violations[k]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int ULID_Verify(const ULID *ulids, const size_t n, const uint64_t min_ms,
+                const uint64_t max_ms, const unsigned threads,
+                ULID_VerifyReport *report) {
+  return verify(verify_ulids, ulids, n, MIN_SLICE, min_ms, max_ms, threads,
+                report);
+}
+
+int ULID_VerifyText(const char *text, const size_t size,
+                    const uint64_t min_ms, const uint64_t max_ms,
+                    const unsigned threads, ULID_VerifyReport *report) {
+  return verify(verify_text, text, size, 32 * MIN_SLICE, min_ms, max_ms,
+                threads, report);
+}
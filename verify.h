@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+ * Verifying ULIDs in parallel, see ULID_Verify() and ULID_VerifyText().
+ *
+ * Input is cut into one slice per thread, each verified on its own into a
+ * segment: counts, violations, and what its ends need to be stitched to its
+ * neighbours.  Segments are then merged in order, which is associative, so
+ * the report is exactly what a single pass over the whole input would give:
+ *
+ * - the last ULID of a segment and the first of the next one are compared
+ *   like any two ULIDs in a row, a violation going between the violations
+ *   of the two segments;
+ * - a run of ULIDs sharing one ms, or a chain of ULIDs each one more than
+ *   the one before, may go across segments; the run or chain at each end is
+ *   kept apart, and only counted once it can grow no more.
+ *
+ * Slices of text are cut anywhere: each thread keeps the ULIDs starting in
+ * its slice, reading as far past it as the last of them needs.
+ */
+
+#include "shared.h"
+#include "ulid.h"
+#include <stdint.h>
+
+typedef struct ULID_VerifySegment {
+  ULID_VerifyReport report; // runs at either end are not in per_ms yet
+  uint64_t first_offset;    // of the first ULID, to report a violation
+  ulid_u128 first, last;    // ULIDs, as numbers
+  uint64_t first_run;       // ULIDs in the run of equal times at each end;
+  uint64_t last_run;        // both are count if it is all one run
+  uint64_t first_chain;     // ULIDs in the chain at each end; both are
+  uint64_t last_chain;      // count if it is all one chain
+} ULID_VerifySegment;